@@ -0,0 +1,737 @@
+/*
+ * AMDGPUInfo - fleet aggregation of saved outputs
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Files are mapped and parsed in place on the worker pool. Every worker
+ * counts into its own hash table keyed by the four group strings, and
+ * the tables are merged once all files are done, so workers never
+ * share anything.
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "aggregate.h"
+#include "filelist.h"
+#include "pool.h"
+
+// files listed per group, the lowest indexes
+#define GROUP_FILES 3
+
+// a group under this share of its GPU model is an outlier...
+#define OUTLIER_PERCENT 5
+// ...once the model is common enough for shares to mean something
+#define OUTLIER_MIN_MODEL 20
+
+#define FIELD_LEN 128
+
+enum {
+	KEY_ASIC = 0,
+	KEY_NAME,
+	KEY_BIOS,
+	KEY_MEMORY,
+	KEYS
+};
+
+static const char *key_names[KEYS] = {
+	[KEY_ASIC] = "asic",
+	[KEY_NAME] = "name",
+	[KEY_BIOS] = "bios_version",
+	[KEY_MEMORY] = "memory",
+};
+
+typedef struct {
+	uint64_t hash;
+	uint32_t key, len;	// "asic\0name\0bios\0memory\0" in the arena
+	uint32_t count;		// 0 for an empty slot
+	uint32_t nfiles;
+	uint32_t files[GROUP_FILES];
+} group_t;
+
+typedef struct {
+	group_t *slots;
+	size_t size, used;	// size is a power of two
+	char *arena;
+	size_t arena_len, arena_alloc;
+} group_table_t;
+
+typedef struct {
+	group_table_t table;
+	unsigned long gpus, empty, unreadable;
+} worker_t;
+
+typedef struct {
+	char *const *files;
+	worker_t *workers;
+} aggregate_t;
+
+// what one line of any of the formats boils down to
+typedef struct {
+	char field[KEYS][FIELD_LEN];
+} record_t;
+
+/***********************************************
+ * Group table
+ ***********************************************/
+static uint64_t hash_key(const char *key, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+		h = (h ^ (unsigned char)key[i]) * 0x100000001b3ull;
+
+	return h;
+}
+
+static bool table_grow(group_table_t *t)
+{
+	size_t size = t->size ? t->size * 2 : 256, i, j;
+	group_t *slots;
+
+	if ((slots = (group_t *)calloc(size, sizeof(group_t))) == NULL)
+		return false;
+
+	for (i = 0; i < t->size; ++i) {
+		if (t->slots[i].count == 0)
+			continue;
+		for (j = t->slots[i].hash & (size - 1); slots[j].count; j = (j + 1) & (size - 1))
+			;
+		slots[j] = t->slots[i];
+	}
+
+	free(t->slots);
+	t->slots = slots;
+	t->size = size;
+
+	return true;
+}
+
+static bool arena_add(group_table_t *t, const char *key, size_t len, uint32_t *offset)
+{
+	size_t alloc;
+	char *arena;
+
+	if (t->arena_len + len > t->arena_alloc) {
+		alloc = t->arena_alloc ? t->arena_alloc : 4096;
+		while (alloc < t->arena_len + len)
+			alloc *= 2;
+		if ((arena = (char *)realloc(t->arena, alloc)) == NULL)
+			return false;
+		t->arena = arena;
+		t->arena_alloc = alloc;
+	}
+
+	memcpy(t->arena + t->arena_len, key, len);
+	*offset = (uint32_t)t->arena_len;
+	t->arena_len += len;
+
+	return true;
+}
+
+// keep the lowest file indexes, so the result does not depend on the workers
+static void group_add_file(group_t *g, uint32_t file)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < g->nfiles && g->files[i] < file; ++i)
+		;
+
+	if ((i < g->nfiles && g->files[i] == file) || i == GROUP_FILES)
+		return;
+
+	if (g->nfiles < GROUP_FILES)
+		++g->nfiles;
+
+	for (j = g->nfiles - 1; j > i; --j)
+		g->files[j] = g->files[j - 1];
+	g->files[i] = file;
+}
+
+static group_t *table_add(group_table_t *t, const char *key, size_t len, uint64_t hash, uint32_t count)
+{
+	group_t *g;
+	size_t i;
+
+	if ((t->used + 1) * 2 > t->size && !table_grow(t))
+		return NULL;
+
+	for (i = hash & (t->size - 1); t->slots[i].count; i = (i + 1) & (t->size - 1)) {
+		g = &t->slots[i];
+		if (g->hash == hash && g->len == len && !memcmp(t->arena + g->key, key, len)) {
+			g->count += count;
+			return g;
+		}
+	}
+
+	g = &t->slots[i];
+	if (!arena_add(t, key, len, &g->key))
+		return NULL;
+
+	g->hash = hash;
+	g->len = (uint32_t)len;
+	g->count = count;
+	g->nfiles = 0;
+	++t->used;
+
+	return g;
+}
+
+static void table_free(group_table_t *t)
+{
+	free(t->slots);
+	free(t->arena);
+}
+
+/***********************************************
+ * Parsers
+ ***********************************************/
+static void set_field(record_t *r, int key, const char *s, size_t len)
+{
+	if (len >= FIELD_LEN)
+		len = FIELD_LEN - 1;
+	memcpy(r->field[key], s, len);
+	r->field[key][len] = 0;
+}
+
+// the next field of a CSV line, quotes and "" escapes removed
+static bool csv_next(const char **p, const char *end, char *buf, size_t len)
+{
+	const char *s = *p;
+	size_t n = 0;
+	bool quoted;
+
+	if (s > end)
+		return false;
+
+	if ((quoted = (s < end && *s == '"')))
+		++s;
+
+	while (s < end) {
+		if (quoted && *s == '"') {
+			if (s + 1 < end && s[1] == '"') {
+				s += 1;
+			} else {
+				quoted = false;
+				++s;
+				continue;
+			}
+		} else if (!quoted && *s == ',') {
+			break;
+		}
+		if (n + 1 < len)
+			buf[n++] = *s;
+		++s;
+	}
+
+	buf[n] = 0;
+	*p = s + 1;
+
+	return true;
+}
+
+enum {
+	COL_ASIC = 0,
+	COL_NAME,
+	COL_BIOS,
+	COL_MEM_NAME,
+	COL_MEM_MANUFACTURER,
+	COL_MEM_MODEL,
+	COLS
+};
+
+static const char *col_names[COLS] = {
+	[COL_ASIC] = "asic",
+	[COL_NAME] = "name",
+	[COL_BIOS] = "bios_version",
+	[COL_MEM_NAME] = "mem_name",
+	[COL_MEM_MANUFACTURER] = "mem_manufacturer",
+	[COL_MEM_MODEL] = "mem_model",
+};
+
+// csv and json spell out what the short format prints for unknown parts
+static void normalize(record_t *r, char cols[COLS][FIELD_LEN])
+{
+	set_field(r, KEY_ASIC, cols[COL_ASIC], strlen(cols[COL_ASIC]));
+	set_field(r, KEY_NAME, cols[COL_NAME], strlen(cols[COL_NAME]));
+	set_field(r, KEY_BIOS, cols[COL_BIOS], strlen(cols[COL_BIOS]));
+
+	if (!r->field[KEY_NAME][0])
+		snprintf(r->field[KEY_NAME], FIELD_LEN, "Unknown GPU");
+	if (!r->field[KEY_BIOS][0])
+		snprintf(r->field[KEY_BIOS], FIELD_LEN, "%s", BLANK_BIOS_VER);
+
+	if (cols[COL_MEM_NAME][0])
+		set_field(r, KEY_MEMORY, cols[COL_MEM_NAME], strlen(cols[COL_MEM_NAME]));
+	else
+		snprintf(r->field[KEY_MEMORY], FIELD_LEN, "Unknown Memory %.8s-%.8s",
+			 cols[COL_MEM_MANUFACTURER], cols[COL_MEM_MODEL]);
+}
+
+static void csv_header(const char *s, const char *end, int *col)
+{
+	char name[FIELD_LEN];
+	int i, n;
+
+	for (i = 0; i < COLS; ++i)
+		col[i] = -1;
+
+	for (n = 0; csv_next(&s, end, name, sizeof(name)); ++n) {
+		for (i = 0; i < COLS; ++i) {
+			if (!strcmp(name, col_names[i]))
+				col[i] = n;
+		}
+	}
+}
+
+static void csv_record(const char *s, const char *end, const int *col, record_t *r)
+{
+	char cols[COLS][FIELD_LEN], buf[FIELD_LEN];
+	int i, n;
+
+	memset(cols, 0, sizeof(cols));
+
+	for (n = 0; csv_next(&s, end, buf, sizeof(buf)); ++n) {
+		for (i = 0; i < COLS; ++i) {
+			if (col[i] == n)
+				memcpy(cols[i], buf, FIELD_LEN);
+		}
+	}
+
+	normalize(r, cols);
+}
+
+// the value of "key": in a json object on one line, strings unescaped
+static void json_get(const char *s, const char *end, const char *key, char *buf, size_t len)
+{
+	char pattern[64];
+	size_t plen, n = 0;
+	const char *p;
+
+	buf[0] = 0;
+	plen = (size_t)snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+
+	if ((p = memmem(s, (size_t)(end - s), pattern, plen)) == NULL)
+		return;
+
+	for (p += plen; p < end && *p == ' '; ++p)
+		;
+
+	if (p < end && *p == '"') {
+		for (++p; p < end && *p != '"'; ++p) {
+			if (*p == '\\' && p + 1 < end)
+				++p;
+			if (n + 1 < len)
+				buf[n++] = *p;
+		}
+	} else {
+		for (; p < end && *p != ',' && *p != '}' && *p != ' '; ++p) {
+			if (n + 1 < len)
+				buf[n++] = *p;
+		}
+	}
+
+	buf[n] = 0;
+}
+
+static void json_record(const char *s, const char *end, record_t *r)
+{
+	char cols[COLS][FIELD_LEN];
+	int i;
+
+	for (i = 0; i < COLS; ++i)
+		json_get(s, end, col_names[i], cols[i], FIELD_LEN);
+
+	normalize(r, cols);
+}
+
+// GPU:<bus.dev.func>:<name>:<bios>:<memconfig>:<memory>:<memory type>:<asic>
+static bool short_record(const char *s, const char *end, record_t *r)
+{
+	const char *field[8];
+	size_t len[8];
+	int n = 0;
+
+	field[0] = s;
+	while (s < end && n < 8) {
+		if (*s == ':') {
+			len[n] = (size_t)(s - field[n]);
+			if (++n < 8)
+				field[n] = s + 1;
+		}
+		++s;
+	}
+
+	if (n == 7) {
+		len[7] = (size_t)(end - field[7]);
+		n = 8;
+	}
+
+	if (n != 8)
+		return false;
+
+	set_field(r, KEY_ASIC, field[7], len[7]);
+	set_field(r, KEY_NAME, field[2], len[2]);
+	set_field(r, KEY_BIOS, field[3], len[3]);
+	set_field(r, KEY_MEMORY, field[5], len[5]);
+
+	// "Unknown GPU 1002-67dfrc7" in short, no name in csv and json
+	if (!strncmp(r->field[KEY_NAME], "Unknown GPU", 11))
+		r->field[KEY_NAME][11] = 0;
+
+	return true;
+}
+
+static bool count_record(worker_t *w, const record_t *r, uint32_t file)
+{
+	char key[KEYS * FIELD_LEN];
+	size_t len = 0, n;
+	group_t *g;
+	int i;
+
+	for (i = 0; i < KEYS; ++i) {
+		n = strlen(r->field[i]) + 1;
+		memcpy(key + len, r->field[i], n);
+		len += n;
+	}
+
+	if ((g = table_add(&w->table, key, len, hash_key(key, len), 1)) == NULL)
+		return false;
+
+	group_add_file(g, file);
+	++w->gpus;
+
+	return true;
+}
+
+static void aggregate_file(void *arg, size_t index, unsigned int worker)
+{
+	aggregate_t *a = arg;
+	worker_t *w = &a->workers[worker];
+	const char *data, *line, *end, *eol;
+	size_t len;
+	int col[COLS];
+	bool csv = false;
+	unsigned long gpus = w->gpus;
+	struct stat st;
+	record_t r;
+	void *map;
+	int fd;
+
+	if ((fd = open(a->files[index], O_RDONLY)) < 0) {
+		++w->unreadable;
+		return;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		++w->empty;
+		return;
+	}
+
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		++w->unreadable;
+		return;
+	}
+
+	madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	data = map;
+	end = data + st.st_size;
+
+	for (line = data; line < end; line = eol + 1) {
+		if ((eol = memchr(line, '\n', (size_t)(end - line))) == NULL)
+			eol = end;
+
+		len = (size_t)(eol - line);
+		if (len > 0 && line[len - 1] == '\r')
+			--len;
+
+		if (len >= 4 && !memcmp(line, "GPU:", 4)) {
+			if (!short_record(line, line + len, &r))
+				continue;
+		} else if (len >= 4 && !memcmp(line, "pci,", 4)) {
+			csv_header(line, line + len, col);
+			csv = true;
+			continue;
+		} else if (memmem(line, len, "{\"pci\":", 7) != NULL) {
+			json_record(line, line + len, &r);
+		} else if (csv && len > 0) {
+			csv_record(line, line + len, col, &r);
+		} else {
+			continue;
+		}
+
+		if (!count_record(w, &r, (uint32_t)index))
+			break;
+	}
+
+	munmap(map, (size_t)st.st_size);
+
+	if (w->gpus == gpus)
+		++w->empty;
+}
+
+/***********************************************
+ * Report
+ ***********************************************/
+typedef struct {
+	const group_t *group;
+	const char *key[KEYS];
+	uint32_t model_total;
+} row_t;
+
+// the GPU model is the asic and name, the first two key strings
+static int compare_model(const row_t *x, const row_t *y)
+{
+	int c;
+
+	if ((c = strcmp(x->key[KEY_ASIC], y->key[KEY_ASIC])) != 0)
+		return c;
+	return strcmp(x->key[KEY_NAME], y->key[KEY_NAME]);
+}
+
+static int compare_rows_key(const void *a, const void *b)
+{
+	const row_t *x = a, *y = b;
+	int c, i;
+
+	if ((c = compare_model(x, y)) != 0)
+		return c;
+	for (i = KEY_BIOS; i < KEYS; ++i) {
+		if ((c = strcmp(x->key[i], y->key[i])) != 0)
+			return c;
+	}
+	return 0;
+}
+
+static int compare_rows_count(const void *a, const void *b)
+{
+	const row_t *x = a, *y = b;
+
+	if (x->group->count != y->group->count)
+		return x->group->count > y->group->count ? -1 : 1;
+	return compare_rows_key(a, b);
+}
+
+static bool is_outlier(const row_t *row)
+{
+	return row->model_total >= OUTLIER_MIN_MODEL &&
+	       (uint64_t)row->group->count * 100 < (uint64_t)row->model_total * OUTLIER_PERCENT;
+}
+
+static double model_share(const row_t *row)
+{
+	return (double)row->group->count / (double)row->model_total;
+}
+
+static void report_text(outbuf_t *out, char *const *files, const row_t *rows, size_t count)
+{
+	size_t i, outliers = 0;
+	uint32_t j;
+
+	outbuf_printf(out, "\n%8s  %-10s  %-26s  %-18s  %s\n", "count", key_names[KEY_ASIC],
+		      key_names[KEY_NAME], key_names[KEY_BIOS], key_names[KEY_MEMORY]);
+
+	for (i = 0; i < count; ++i) {
+		outbuf_printf(out, "%8u  %-10s  %-26s  %-18s  %s\n", rows[i].group->count,
+			      rows[i].key[KEY_ASIC], rows[i].key[KEY_NAME],
+			      rows[i].key[KEY_BIOS], rows[i].key[KEY_MEMORY]);
+		if (is_outlier(&rows[i]))
+			++outliers;
+	}
+
+	if (outliers == 0)
+		return;
+
+	outbuf_printf(out, "\nOutliers, under %d%% of their GPU model:\n", OUTLIER_PERCENT);
+
+	for (i = 0; i < count; ++i) {
+		if (!is_outlier(&rows[i]))
+			continue;
+		outbuf_printf(out, "%8u  %-10s  %-26s  %-18s  %s  (%.1f%%, in ", rows[i].group->count,
+			      rows[i].key[KEY_ASIC], rows[i].key[KEY_NAME],
+			      rows[i].key[KEY_BIOS], rows[i].key[KEY_MEMORY],
+			      model_share(&rows[i]) * 100.0);
+		for (j = 0; j < rows[i].group->nfiles; ++j)
+			outbuf_printf(out, "%s%s", j ? ", " : "", files[rows[i].group->files[j]]);
+		outbuf_puts(out, rows[i].group->count > rows[i].group->nfiles ? ", ...)\n" : ")\n");
+	}
+}
+
+static void report_json(outbuf_t *out, char *const *files, const row_t *rows, size_t count)
+{
+	size_t i;
+	uint32_t j;
+	int k;
+
+	outbuf_puts(out, ", \"groups\": [");
+
+	for (i = 0; i < count; ++i) {
+		outbuf_printf(out, "%s\n  {\"count\": %u", i ? "," : "", rows[i].group->count);
+		for (k = 0; k < KEYS; ++k) {
+			outbuf_printf(out, ", \"%s\": ", key_names[k]);
+			outbuf_json_string(out, rows[i].key[k]);
+		}
+		outbuf_printf(out, ", \"model_share\": %.4f, \"outlier\": %s, \"files\": [",
+			      model_share(&rows[i]), is_outlier(&rows[i]) ? "true" : "false");
+		for (j = 0; j < rows[i].group->nfiles; ++j) {
+			if (j)
+				outbuf_puts(out, ", ");
+			outbuf_json_string(out, files[rows[i].group->files[j]]);
+		}
+		outbuf_puts(out, "]}");
+	}
+
+	outbuf_puts(out, count ? "\n]}\n" : "]}\n");
+}
+
+static void report_csv(outbuf_t *out, char *const *files, const row_t *rows, size_t count)
+{
+	char list[GROUP_FILES * 1024];
+	size_t i, used;
+	uint32_t j;
+	int k;
+
+	outbuf_puts(out, "count,asic,name,bios_version,memory,model_share,outlier,files\n");
+
+	for (i = 0; i < count; ++i) {
+		outbuf_printf(out, "%u", rows[i].group->count);
+		for (k = 0; k < KEYS; ++k) {
+			outbuf_puts(out, ",");
+			outbuf_csv_string(out, rows[i].key[k]);
+		}
+		outbuf_printf(out, ",%.4f,%s,", model_share(&rows[i]), is_outlier(&rows[i]) ? "true" : "false");
+
+		// one field, space separated
+		for (j = 0, used = 0; j < rows[i].group->nfiles && used < sizeof(list); ++j)
+			used += (size_t)snprintf(list + used, sizeof(list) - used, "%s%s", j ? " " : "", files[rows[i].group->files[j]]);
+		outbuf_csv_string(out, rows[i].group->nfiles ? list : "");
+		outbuf_puts(out, "\n");
+	}
+}
+
+static bool report(const aggregate_t *a, const group_table_t *t, size_t nfiles,
+		   unsigned long gpus, unsigned long empty, unsigned long unreadable,
+		   output_format_t format, int fd)
+{
+	row_t *rows;
+	size_t i, j, n = 0, first;
+	uint32_t total;
+	const char *s;
+	outbuf_t out;
+	bool ok;
+	int k;
+
+	if ((rows = (row_t *)calloc(t->used ? t->used : 1, sizeof(row_t))) == NULL)
+		return false;
+
+	for (i = 0; i < t->size; ++i) {
+		if (t->slots[i].count == 0)
+			continue;
+		rows[n].group = &t->slots[i];
+		for (k = 0, s = t->arena + t->slots[i].key; k < KEYS; ++k, s += strlen(s) + 1)
+			rows[n].key[k] = s;
+		++n;
+	}
+
+	// rows of a model are next to each other in key order
+	qsort(rows, n, sizeof(row_t), compare_rows_key);
+	for (first = 0; first < n; first = i) {
+		total = 0;
+		for (i = first; i < n && !compare_model(&rows[first], &rows[i]); ++i)
+			total += rows[i].group->count;
+		for (j = first; j < i; ++j)
+			rows[j].model_total = total;
+	}
+	qsort(rows, n, sizeof(row_t), compare_rows_count);
+
+	outbuf_init(&out, fd);
+
+	if (format == OUTPUT_JSON) {
+		outbuf_printf(&out, "{\"files\": %zu, \"empty\": %lu, \"unreadable\": %lu, \"gpus\": %lu",
+			      nfiles, empty, unreadable, gpus);
+		report_json(&out, a->files, rows, n);
+	} else if (format == OUTPUT_CSV) {
+		report_csv(&out, a->files, rows, n);
+	} else {
+		outbuf_printf(&out, "%lu GPUs in %zu files (%lu without GPUs, %lu unreadable)\n",
+			      gpus, nfiles, empty, unreadable);
+		report_text(&out, a->files, rows, n);
+	}
+
+	ok = outbuf_flush(&out);
+	outbuf_free(&out);
+	free(rows);
+
+	return ok;
+}
+
+long aggregate_files(char *const *paths, size_t count, unsigned int jobs,
+		     output_format_t format, int fd)
+{
+	file_list_t list = { NULL, 0, 0 };
+	unsigned long gpus = 0, empty = 0, unreadable = 0;
+	group_table_t total;
+	unsigned int workers = 0, i;
+	const group_t *g;
+	group_t *merged;
+	aggregate_t a;
+	long ret = -1;
+	size_t j;
+	uint32_t f;
+
+	memset(&total, 0, sizeof(total));
+	a.workers = NULL;
+
+	if (!file_list_paths(&list, paths, count))
+		goto out;
+
+	workers = pool_workers(jobs, list.count);
+	a.files = list.files;
+	if ((a.workers = (worker_t *)calloc(workers ? workers : 1, sizeof(worker_t))) == NULL)
+		goto out;
+
+	pool_run(workers, list.count, aggregate_file, &a);
+
+	for (i = 0; i < workers; ++i) {
+		gpus += a.workers[i].gpus;
+		empty += a.workers[i].empty;
+		unreadable += a.workers[i].unreadable;
+
+		for (j = 0; j < a.workers[i].table.size; ++j) {
+			g = &a.workers[i].table.slots[j];
+			if (g->count == 0)
+				continue;
+			if ((merged = table_add(&total, a.workers[i].table.arena + g->key, g->len, g->hash, g->count)) == NULL)
+				goto out;
+			for (f = 0; f < g->nfiles; ++f)
+				group_add_file(merged, g->files[f]);
+		}
+	}
+
+	if (report(&a, &total, list.count, gpus, empty, unreadable, format, fd))
+		ret = (long)list.count;
+
+out:
+	if (a.workers != NULL) {
+		for (i = 0; i < workers; ++i)
+			table_free(&a.workers[i].table);
+		free(a.workers);
+	}
+	table_free(&total);
+	file_list_free(&list);
+
+	return ret;
+}
@@ -0,0 +1,24 @@
+/*
+ * AMDGPUInfo - fleet aggregation of saved outputs
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <stddef.h>
+
+#include "output.h"
+
+/*
+ * Read amdgpuinfo outputs saved in the short, csv or json format, one
+ * file per host, directories are searched recursively. GPUs are counted
+ * by ASIC, name, BIOS version and memory, and the rare combinations of
+ * each GPU model are flagged as outliers, with files they came from.
+ * Returns the number of files read, or -1 on error.
+ */
+long aggregate_files(char *const *paths, size_t count, unsigned int jobs,
+		     output_format_t format, int fd);
+
+#endif
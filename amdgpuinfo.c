@@ -11,133 +11,77 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <fcntl.h>
 #include <unistd.h>
-#include <sys/mman.h>
-#include <pci/pci.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <limits.h>
+#include <math.h>
 #include <stdarg.h>
-#include <regex.h>
 #include <strings.h>
 
 #include "config.h"
+#include "amdgpuinfo.h"
+#include "aggregate.h"
+#include "analyze.h"
+#include "cache.h"
+#include "output.h"
+#include "snapshot.h"
+#include "telemetry.h"
+
+#define LOG_INFO AMDGPUINFO_LOG_INFO
+#define LOG_ERROR AMDGPUINFO_LOG_ERROR
 
-#define LOG_INFO 1
-#define LOG_ERROR 2
-
-#define MEM_UNKNOWN 0x0
-#define MEM_GDDR5 0x5
-#define MEM_HBM  0x6
-#define MEM_GDDR6 0x7
-
-#define mmMC_SEQ_MISC0 0xa80
-#define mmMC_SEQ_MISC0_FIJI 0xa71
-
-#define AMD_PCI_VENDOR_ID 0x1002
-
-#define BLANK_BIOS_VER "xxx-xxx-xxxx"
-
-typedef enum AMD_CHIPS {
-	CHIP_UNKNOWN = 0,
-	CHIP_CYPRESS,
-	CHIP_HEMLOCK,
-	CHIP_CAICOS,
-	CHIP_BARTS,
-	CHIP_CAYMAN,
-	CHIP_ANTILLES,
-	CHIP_TAHITI,
-	CHIP_PITCAIRN,
-	CHIP_VERDE,
-	CHIP_OLAND,
-	CHIP_HAINAN,
-	CHIP_BONAIRE,
-	CHIP_KAVERI,
-	CHIP_KABINI,
-	CHIP_HAWAII,
-	CHIP_MULLINS,
-	CHIP_TOPAZ,
-	CHIP_TONGA,
-	CHIP_FIJI,
-	CHIP_CARRIZO,
-	CHIP_STONEY,
-	CHIP_POLARIS10,
-	CHIP_POLARIS11,
-	CHIP_POLARIS12,
-	CHIP_POLARIS20,
-	CHIP_POLARIS30,
-	CHIP_VEGA10,
-	CHIP_VEGA20,
-	CHIP_NAVI10,
-	CHIP_NAVI12,
-	CHIP_NAVI14,
-	CHIP_RAVEN,
-} asic_type_t;
-
-static const char *mem_type_label[] = {
-	"Unknown",
-	"DDR1",
-	"DDR2",
-	"DDR3",
-	"DDR4",
-	"GDDR5",
-	"GDDR6",
-	"HBM",
-};
-
-static const char *amd_asic_name[] = {
-	"Unknown",
-	"Cypress",
-	"Hemlock",
-	"Caicos",
-	"Barts",
-	"Cayman",
-	"Antilles",
-	"Tahiti",
-	"Pitcairn",
-	"Verde",
-	"Oland",
-	"Hainan",
-	"Bonaire",
-	"Kaveri",
-	"Kabini",
-	"Hawaii",
-	"Mullins",
-	"Topaz",
-	"Tonga",
-	"Fiji",
-	"Carrizo",
-	"Stoney",
-	"Polaris10",
-	"Polaris11",
-	"Polaris12",
-	"Polaris20",
-	"Polaris30",
-	"Vega10",
-	"Vega20",
-	"Navi10",
-	"Navi12",
-	"Navi14",
-	"Raven",
-};
 
 /***********************************
  * Program Options
  ***********************************/
-bool opt_bios_only = false; // --biosonly / -b
-bool opt_output_short = false; // --short / -s
+output_format_t opt_format = OUTPUT_TEXT; // --format / --short / --biosonly
+unsigned int opt_jobs = 0; // --jobs / -j, 0 = one per online CPU
+const char *opt_cache_dir = CACHE_DIR; // --cache DIR / --no-cache
+const char *opt_prometheus = NULL; // --prometheus FILE
+const char *opt_sysfs_path = NULL; // --sysfs PATH, libpci's sysfs.path
+bool opt_libpci = false; // --libpci
+bool opt_pci_ids = true; // --no-pci-ids
+const char *opt_record = NULL; // --record FILE
+const char *opt_replay = NULL; // --replay FILE
+unsigned int opt_replay_latency = 0; // --replay-latency USEC
+bool opt_timings = false; // --timings
+const char *opt_db = NULL; // --db FILE, GPUDB_PATH when it exists otherwise
+const char *opt_snapshot = NULL; // --snapshot FILE
+const char *opt_diff = NULL; // --diff FILE
+double opt_timeout = 0; // --timeout SECONDS, per device, 0 = none
+double opt_watch = 0; // --watch INTERVAL, seconds
+unsigned long opt_watch_samples = 0; // --watch-samples N, 0 = until interrupted
+char **opt_analyze = NULL; // --analyze-roms DIR|FILE..., points into argv
+size_t opt_analyze_count = 0;
+char **opt_aggregate = NULL; // --aggregate DIR|FILE..., points into argv
+size_t opt_aggregate_count = 0;
+const char *opt_catalog = NULL; // --catalog FILE
+output_fields_t opt_fields; // --fields LIST
+bool opt_fields_set = false;
+amdgpuinfo_select_t *opt_select = NULL; // --device BDF / --id VVVV:DDDD, any of them
+size_t opt_select_count = 0;
+bool opt_help = false; // --help / -h
 
 // output function that only displays if verbose is on
-static void print(int priority, const char *fmt, ...)
+static void vprint(void *data, int priority, const char *fmt, va_list args)
 {
-	va_list args;
+	(void)data;
 
-	va_start(args, fmt);
-	if (priority == LOG_ERROR) {
+	// machine readable output owns stdout
+	if (priority == LOG_ERROR || !output_is_text(opt_format)) {
 		vfprintf(stderr, fmt, args);
 	} else {
 		vprintf(fmt, args);
 	}
+}
+
+static void print(int priority, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vprint(NULL, priority, fmt, args);
 	va_end(args);
 }
 
@@ -148,678 +92,492 @@ static void showhelp(char *program)
 	NAME " v"  VERSION "\n\n"
 	"Usage: %s [options]\n\n"
 	"Options:\n"
+	"--aggregate DIR|FILE...	Count the GPUs in saved short, csv or json outputs of many hosts\n"
+	"--analyze-roms DIR|FILE...	Read VBIOS dumps instead of the installed GPUs\n"
 	"-b, --biosonly	Only output BIOS Versions (implies -s with <BIOSVersion> output)\n"
+	"--catalog FILE	Check VBIOS fingerprints against the known good images in FILE\n"
+	"--cache DIR	Keep probe results in DIR until reboot (default: " CACHE_DIR ")\n"
+	"--db FILE	Load the GPU and memory tables from FILE (default: " GPUDB_PATH " if present)\n"
+	"--device BDF	Only probe the GPU at PCI address [DDDD:]BB:DD.F, can be repeated\n"
+	"--diff FILE	Only output what changed since the snapshot in FILE\n"
+	"-f, --format F	Output format: text, short, bios, json or csv (default: text)\n"
+	"--fields LIST	Only find out and output these comma separated fields, see -f json for names\n"
 	"-h, --help	Help\n"
+	"--id VVVV:DDDD	Only probe the GPUs with this vendor and device ID, can be repeated\n"
+	"--prometheus FILE	Write node_exporter textfile metrics to FILE instead of printing\n"
+	"--record FILE	Log every hardware access of this run to FILE\n"
+	"--replay FILE	Probe the hardware recorded in FILE instead of this machine\n"
+	"--replay-latency USEC	Make every replayed read take USEC microseconds, for benchmarks\n"
+	"--libpci	Enumerate GPUs with a full libpci bus scan instead of sysfs\n"
+	"-j, --jobs N	Probe up to N GPUs in parallel (default: number of CPUs)\n"
+	"--no-cache	Always probe the hardware, do not read or write the cache\n"
+	"--no-pci-ids	Only use the built-in board vendor names, never load pci.ids\n"
+	"--snapshot FILE	Save the devices found to FILE, for a later --diff\n"
+	"--sysfs PATH	Read devices from PATH instead of /sys/bus/pci\n"
+	"--timeout SECONDS	Give up on a GPU after SECONDS and report what was found so far\n"
+	"--timings	Print how long each phase took, per device and in total, to stderr\n"
+	"--watch INTERVAL	Sample temperature, power, fan, load and VRAM use every INTERVAL seconds\n"
+	"--watch-samples N	Stop --watch after N samples (default: on SIGINT or SIGTERM)\n"
 	"-s, --short	Short form output - 1 GPU/line - <PCI Bus.Dev.Func>:<GPU Type>:<BIOSVersion>:<Memory Type>\n"
 	"\n", program);
 }
 
 
-// parse command line options
-static bool load_options(int argc, char *argv[])
+// [DDDD:]BB:DD.F or VVVV:DDDD
+static bool parse_select(const char *s, bool by_id, amdgpuinfo_select_t *sel)
 {
-	int i;
-
-	for (i = 1; i < argc; ++i)
-	{
-		if (!strcasecmp("--help", argv[i]) || !strcasecmp("-h", argv[i])) {
-			showhelp(argv[0]);
-			return false;
-		} else if (!strcasecmp("--biosonly", argv[i]) || !strcasecmp("-b", argv[i])) {
-			opt_bios_only = true;
-			opt_output_short = true;
-		} else if (!strcasecmp("--short", argv[i]) || !strcasecmp("-s", argv[i])) {
-			opt_output_short = true;
-		}
-	}
-
-	return true;
-}
+	unsigned int domain = 0, bus, dev, func, vendor, device;
+	char end;
 
-/***********************************************
- * GPU Types
- ***************************************************/
-typedef struct {
-	unsigned int device_id;
-	unsigned long subsys_id;
-	unsigned char rev_id;
-	const char *name;
-	unsigned int asic_type;
-} gputype_t;
-
-static gputype_t gputypes[] = {
-	/* Vega */
-	{ 0x687f, 0, 0,	   "Radeon RX Vega", CHIP_VEGA10},
-	{ 0x687f, 0, 0xc0, "Radeon RX Vega 64", CHIP_VEGA10},
-	{ 0x687f, 0, 0xc1, "Radeon RX Vega 64", CHIP_VEGA10},
-	{ 0x687f, 0, 0xc3, "Radeon RX Vega 56", CHIP_VEGA10},
-	{ 0x6863, 0, 0,	   "Radeon Vega FE", CHIP_VEGA10},
-
-	/*Vega20*/
-	{ 0x66af, 0, 0,	   "Radeon VII", CHIP_VEGA20},
-	{ 0x66af, 0, 0xc4, "Radeon VII", CHIP_VEGA20},
-
-	/*Navi10*/
-	{ 0x7310, 0, 0,	"Radeon RX 5700",   CHIP_NAVI10},
-	{ 0x7312, 0, 0,	"Radeon Pro W5700", CHIP_NAVI10},
-	{ 0x7318, 0, 0,	"Radeon RX 5700", CHIP_NAVI10},
-	{ 0x7319, 0, 0,	"Radeon RX 5700", CHIP_NAVI10},
-	{ 0x731a, 0, 0,	"Radeon RX 5700", CHIP_NAVI10},
-	{ 0x731b, 0, 0,	"Radeon RX 5700", CHIP_NAVI10},
-	{ 0x731f, 0, 0,	"Radeon RX 5600/5700",  CHIP_NAVI10},
-	{ 0x731f, 0, 0xc0, "Radeon RX 5700 XT", CHIP_NAVI10}, /* XTX or 50th Anniversary Edition */
-	{ 0x731f, 0, 0xc1, "Radeon RX 5700 XT", CHIP_NAVI10},
-	{ 0x731f, 0, 0xc4, "Radeon RX 5700",    CHIP_NAVI10},
-	{ 0x731f, 0, 0xca, "Radeon RX 5600 XT", CHIP_NAVI10},
-	/* Navi12 */
-	{ 0x7360, 0, 0, "Radeon Navi 12", CHIP_NAVI12},
-	{ 0x7362, 0, 0, "Radeon Navi 12", CHIP_NAVI12},
-
-	/*Navi14*/
-	{ 0x7340, 0, 0,	"Radeon RX 5500", CHIP_NAVI14},
-	{ 0x7340, 0, 0xc5, "Radeon RX 5500 XT", CHIP_NAVI14},
-	{ 0x7341, 0, 0, "Radeon Pro W5500", CHIP_NAVI14},
-	{ 0x7347, 0, 0, "Radeon Pro W5500M", CHIP_NAVI14},
-	{ 0x734f, 0, 0, "Radeon Pro W5500M", CHIP_NAVI14},
-
-	/* Fury/Nano */
-	{ 0x7300, 0, 0,	"Radeon R9 Fury/Nano/X", CHIP_FIJI},
-	{ 0x7300, 0, 0xc8, "Radeon R9 Fury/Nano/X", CHIP_FIJI},
-	{ 0x7300, 0, 0xc9, "Radeon R9 Fury/Nano/X", CHIP_FIJI},
-	{ 0x7300, 0, 0xca, "Radeon R9 Fury/Nano/X", CHIP_FIJI},
-	{ 0x7300, 0, 0xcb, "Radeon R9 Fury", CHIP_FIJI},
-	/* RX 5xx */
-	{ 0x67df, 0, 0xe7, "Radeon RX 580", CHIP_POLARIS10},
-	{ 0x67df, 0, 0xef, "Radeon RX 570", CHIP_POLARIS10},
-
-	{ 0x67df, 0, 0xe1, "Radeon RX 590", CHIP_POLARIS30},	 /* AMD Radeon RX 590 */
-	{ 0x6fdf, 0, 0xef, "Radeon RX 580", CHIP_POLARIS20},	 /* AMD Radeon RX 580 2048SP */
-
-	{ 0x67ff, 0, 0xcf, "Radeon RX 560", CHIP_POLARIS11},
-	{ 0x67ef, 0, 0xe5, "Radeon RX 560", CHIP_POLARIS11},	/* known also as RX560D with CU 14/shaders 896 */
-	{ 0x67ff, 0, 0xff, "Radeon RX 550", CHIP_POLARIS11},	/* new RX550 with 640 shaders */
-	{ 0x699f, 0, 0xc7, "Radeon RX 550", CHIP_POLARIS12},
-	/* RX 4xx */
-	{ 0x67df, 0, 0, "Radeon RX 470/480", CHIP_POLARIS10},
-	{ 0x67df, 0, 0xc7, "Radeon RX 480",  CHIP_POLARIS10},
-	{ 0x67df, 0, 0xcf, "Radeon RX 470",  CHIP_POLARIS10},
-	{ 0x67ef, 0, 0, "Radeon RX 460",     CHIP_POLARIS11},
-	{ 0x67ef, 0, 0xc0, "Radeon RX 460",  CHIP_POLARIS11},
-	{ 0x67ef, 0, 0xc1, "Radeon RX 460",  CHIP_POLARIS11},
-	{ 0x67ef, 0, 0xc5, "Radeon RX 460",  CHIP_POLARIS11},
-	{ 0x67ef, 0, 0xcf, "Radeon RX 460",  CHIP_POLARIS11},
-	/* R9 3xx */
-	{ 0x67b1, 0, 0x80, "Radeon R9 390",  CHIP_HAWAII},
-	{ 0x67b0, 0, 0x80, "Radeon R9 390x", CHIP_HAWAII},
-	{ 0x6939, 0, 0xf1, "Radeon R9 380",  CHIP_TONGA},
-	{ 0x6938, 0, 0, "Radeon R9 380x",    CHIP_TONGA},
-	{ 0x6810, 0, 0x81, "Radeon R7 370",  CHIP_PITCAIRN},
-	{ 0x665f, 0, 0x81, "Radeon R7 360",  CHIP_BONAIRE},
-	/* R9 2xx */
-	{ 0x67B9, 0, 0, "Radeon R9 295x2", CHIP_HAWAII},
-	{ 0x67b1, 0, 0, "Radeon R9 290/R9 390", CHIP_HAWAII},
-	{ 0x67b0, 0, 0, "Radeon R9 290x/R9 390x", CHIP_HAWAII},
-	{ 0x6939, 0, 0, "Radeon R9 285/R9 380", CHIP_TONGA},
-	{ 0x6811, 0, 0, "Radeon R9 270", CHIP_PITCAIRN},
-	{ 0x6810, 0, 0, "Radeon R9 270x/R7 370", CHIP_PITCAIRN},
-	{ 0x6658, 0, 0, "Radeon R7 260x", CHIP_BONAIRE},
-	/* HD 7xxx */
-	{ 0x679b, 0, 0, "Radeon HD7990", CHIP_TAHITI},
-	{ 0x6798, 0, 0, "Radeon HD7970/R9 280x", CHIP_TAHITI},
-	{ 0x679a, 0, 0, "Radeon HD7950/R9 280", CHIP_TAHITI},
-	{ 0x679E, 0, 0, "Radeon HD7870XT", CHIP_TAHITI},
-	{ 0x6818, 0, 0, "Radeon HD7870", CHIP_PITCAIRN},
-	{ 0x6819, 0, 0, "Radeon HD7850", CHIP_PITCAIRN},
-	{ 0x665C, 0, 0, "Radeon HD7790", CHIP_BONAIRE},
-	/* HD 6xxx */
-	{ 0x671D, 0, 0, "Radeon HD6990", CHIP_ANTILLES},
-	{ 0x6718, 0, 0, "Radeon HD6970", CHIP_CAYMAN},
-	{ 0x6719, 0, 0, "Radeon HD6950", CHIP_CAYMAN},
-	{ 0x671F, 0, 0, "Radeon HD6930", CHIP_CAYMAN},
-	{ 0x6738, 0, 0, "Radeon HD6870", CHIP_BARTS},
-	{ 0x6739, 0, 0, "Radeon HD6850", CHIP_BARTS},
-	{ 0x6778, 0, 0, "Radeon HD6450/HD7470", CHIP_CAICOS},
-	{ 0x6779, 0, 0, "Radeon HD6450", CHIP_CAICOS},
-	/* HD 5xxx */
-	{ 0x689C, 0, 0, "Radeon HD5970", CHIP_HEMLOCK},
-	{ 0x6898, 0, 0, "Radeon HD5870", CHIP_CYPRESS},
-	{ 0x6899, 0, 0, "Radeon HD5850", CHIP_CYPRESS},
-	{ 0x689E, 0, 0, "Radeon HD5830", CHIP_CYPRESS},
-
-	{ 0, 0, 0, "Unknown", CHIP_UNKNOWN}
-};
-
-// find GPU type by vendor id/device id
-static gputype_t *_find_gpu(unsigned int device_id, unsigned long subsys_id, unsigned char rev_id)
-{
-	gputype_t *g = gputypes;
+	memset(sel, 0, sizeof(*sel));
+	sel->by_id = by_id;
 
-	while (g->device_id)
-	{
-		if (g->device_id == device_id &&
-		    g->subsys_id == subsys_id &&
-		    g->rev_id == rev_id) {
-			return g;
-		}
-		++g;
+	if (by_id) {
+		if (sscanf(s, "%x:%x%c", &vendor, &device, &end) != 2 || vendor > 0xffff || device > 0xffff)
+			return false;
+		sel->vendor_id = vendor;
+		sel->device_id = device;
+		return true;
 	}
 
-	return NULL;
-}
-
-// find GPU type by vendor id/device id
-static gputype_t *find_gpu(unsigned int device_id, unsigned long subsys_id, unsigned char rev_id)
-{
-	gputype_t *g = _find_gpu(device_id, subsys_id, rev_id);
-
-	//if specific subsys id not found, try again with 0
-	if (g == NULL && subsys_id > 0) {
-		g = _find_gpu(device_id, 0, rev_id);
+	if (sscanf(s, "%x:%x:%x.%x%c", &domain, &bus, &dev, &func, &end) != 4) {
+		domain = 0;
+		if (sscanf(s, "%x:%x.%x%c", &bus, &dev, &func, &end) != 3)
+			return false;
 	}
 
-	//if specific rev id not found, try again with 0 for general device type
-	if (g == NULL && rev_id > 0) {
-		g = _find_gpu(device_id, subsys_id, 0);
-	}
+	if (domain > 0xffff || bus > 0xff || dev > 0x1f || func > 7)
+		return false;
 
-	//if still not found, try no rev id or subsys id
-	if (g == NULL) {
-		g = _find_gpu(device_id, 0, 0);
-	}
+	sel->domain = (int)domain;
+	sel->bus = (int)bus;
+	sel->dev = (int)dev;
+	sel->func = (int)func;
 
-	return g;
+	return true;
 }
 
-/*************************************************
- * Memory Models
- *************************************************/
-typedef struct {
-	int type;
-	int manufacturer;
-	int model;
-	const char *name;
-} memtype_t;
-
-
-/*
- * Memory type information can be determined by using "amdmeminfo -c". This will output the MC scratch register value.
- * The format of the MC scratch register is: 0xTXXXMVXX where T = Memory Type, V = Vendor ID and M is Memory Model ID
- *
- * For example the value: 0x506021f2 translates to T = 0x5, V = 0x1 and M = 0x2. This leads us to the record below:
- *		{ MEM_GDDR5, 0x1, 0x2, "Samsung K4G80325FB" }
- */
-static memtype_t memtypes[] = {
-	/* GDDR5 */
-	{ MEM_GDDR5, 0x1, -1, "Unknown Samsung GDDR5" },
-	{ MEM_GDDR5, 0x1, 0x0, "Samsung K4G20325FD" },
-	{ MEM_GDDR5, 0x1, 0x2, "Samsung K4G80325FB" },
-	{ MEM_GDDR5, 0x1, 0x3, "Samsung K4G20325FD" },
-	{ MEM_GDDR5, 0x1, 0x6, "Samsung K4G20325FS" },
-	{ MEM_GDDR5, 0x1, 0x9, "Samsung K4G41325FE" },
-	{ MEM_GDDR5, 0x2, -1, "Unknown Infineon GDDR5" },
-	{ MEM_GDDR5, 0x3, -1, "Unknown Elpida GDDR5 GDDR5" },
-	{ MEM_GDDR5, 0x3, 0x0, "Elpida EDW4032BABG" },
-	{ MEM_GDDR5, 0x3, 0x1, "Elpida EDW2032BBBG" },
-	{ MEM_GDDR5, 0x4, -1, "Unknown Etron GDDR5" },
-	{ MEM_GDDR5, 0x5, -1, "Unknown Nanya GDDR5" },
-	{ MEM_GDDR5, 0x6, -1, "Unknown SK Hynix GDDR5" },
-	{ MEM_GDDR5, 0x6, 0x2, "SK Hynix H5GQ2H24MFR" },
-	{ MEM_GDDR5, 0x6, 0x3, "SK Hynix H5GQ2H24AFR" },
-	{ MEM_GDDR5, 0x6, 0x4, "SK Hynix H5GC2H24BFR" },
-	{ MEM_GDDR5, 0x6, 0x5, "SK Hynix H5GQ4H24MFR" },
-	{ MEM_GDDR5, 0x6, 0x6, "SK Hynix H5GC4H24AJR" },
-	{ MEM_GDDR5, 0x6, 0x7, "SK Hynix H5GQ8H24MJR" },
-	{ MEM_GDDR5, 0x6, 0x8, "SK Hynix H5GC8H24AJR" },
-	{ MEM_GDDR5, 0x7, -1, "Unknown Mosel GDDR5" },
-	{ MEM_GDDR5, 0x8, -1, "Unknown Winbond GDDR5" },
-	{ MEM_GDDR5, 0x9, -1, "Unknown ESMT GDDR5" },
-	{ MEM_GDDR5, 0xf, -1, "Unknown Micron" },
-	{ MEM_GDDR5, 0xf, 0x1, "Micron MT51J256M32" },
-	{ MEM_GDDR5, 0xf, 0x0, "Micron MT51J256M3" },
-
-	/* HBM */
-	{ MEM_HBM, 0x1, -1, "Unknown Samsung HBM" },
-	{ MEM_HBM, 0x1, 0, "Samsung KHA843801B" },
-	{ MEM_HBM, 0x2, -1, "Unknown Infineon HBM" },
-	{ MEM_HBM, 0x3, -1, "Unknown Elpida HBM" },
-	{ MEM_HBM, 0x4, -1, "Unknown Etron HBM" },
-	{ MEM_HBM, 0x5, -1, "Unknown Nanya HBM" },
-	{ MEM_HBM, 0x6, -1, "Unknown SK Hynix HBM" },
-	{ MEM_HBM, 0x6, 0x0, "SK Hynix H5VR2GCCM" },
-	{ MEM_HBM, 0x7, -1, "Unknown Mosel HBM" },
-	{ MEM_HBM, 0x8, -1, "Unknown Winbond HBM" },
-	{ MEM_HBM, 0x9, -1, "Unknown ESMT HBM" },
-	{ MEM_HBM, 0xf, -1, "Unknown Micron HBM" },
-
-	/* GDDR6 */
-	{ MEM_GDDR6, 0x1, -1, "Samsung GDDR6"},
-	{ MEM_GDDR6, 0x1, 0x8, "Samsung K4Z80325BC"},
-	{ MEM_GDDR6, 0x6, -1, "Hynix GDDR6"},
-	{ MEM_GDDR6, 0xf, -1, "Micron GDDR6"},
-	{ MEM_GDDR6, 0xf, 0x0, "Micron MT61K256M32"},
-
-	/* UNKNOWN LAST */
-	{ MEM_GDDR5, -1, -1, "GDDR5"},
-	{ MEM_GDDR6, -1, -1, "GDDR6"},
-	{ MEM_HBM, -1, -1, "Unknown HBM"},
-	{ MEM_UNKNOWN, -1, -1, "Unknown Memory"},
-};
-
-
-// Find Memory Model by manufacturer/model
-static memtype_t *find_mem(int mem_type, int manufacturer, int model)
+// the whole of s as a decimal number between min and max
+static bool parse_number(const char *s, unsigned long min, unsigned long max, unsigned long *val)
 {
-	memtype_t *m = memtypes;
+	char *end;
 
-	while (m->type)
-	{
-		if (m->type == mem_type &&
-		    m->manufacturer == manufacturer &&
-		    m->model == model)
-			return m;
-		++m;
-	}
+	// strtoul() would take "-1" as ULONG_MAX
+	if (*s == '-')
+		return false;
 
-	if (model > -1) {
-		return find_mem(mem_type, manufacturer, -1);
-	}
+	errno = 0;
+	*val = strtoul(s, &end, 10);
 
-	return NULL;
+	return end != s && *end == '\0' && errno == 0 && *val >= min && *val <= max;
 }
 
-/**********************************************
- * Device List
- **********************************************/
-
-typedef struct gpu {
-	u16 vendor_id, device_id;
-	gputype_t *gpu;
-	memtype_t *mem;
-	int memconfig, mem_type, mem_manufacturer, mem_model;
-	u8 pcibus, pcidev, pcifunc, pcirev;
-	u32 subvendor, subdevice;
-	char *path;
-	unsigned char *vbios;
-	char bios_version[64];
-	struct gpu *prev, *next;
-} gpu_t;
-
-static gpu_t *device_list = NULL, *last_device = NULL;
-
-// add new device
-static gpu_t *new_device()
+// the whole of s as a finite number of seconds
+static bool parse_seconds(const char *s, double *val)
 {
-	gpu_t *d;
+	char *end;
 
-	if ((d = (gpu_t *)malloc(sizeof(gpu_t))) == NULL) {
-		print(LOG_ERROR, "malloc() failed in new_device()\n");
-		return NULL;
-	}
+	errno = 0;
+	*val = strtod(s, &end);
 
-	// default values
-	d->gpu = NULL;
-	d->mem = NULL;
-	d->vbios = NULL;
-	d->path = NULL;
-	memset(d->bios_version, 0, 64);
-	d->next = d->prev = NULL;
-	d->mem_manufacturer = 0;
-	d->mem_model = 0;
-
-	if (device_list == NULL && last_device == NULL) {
-		device_list = last_device = d;
-	} else {
-		last_device->next = d;
-		d->prev = last_device;
-		last_device = d;
-	}
-
-	return d;
+	return end != s && *end == '\0' && errno == 0 && isfinite(*val);
 }
 
-// free device memory
-static void free_devices()
+// parse command line options, false on a bad option or argument
+static bool load_options(int argc, char *argv[])
 {
-	gpu_t *d;
+	amdgpuinfo_select_t sel, *grown;
+	unsigned long n;
+	bool by_id;
+	size_t j;
+	int i;
 
-	while(last_device)
+	for (i = 1; i < argc; ++i)
 	{
-		d = last_device;
-		last_device = d->prev;
-
-		if (d->vbios != NULL) {
-			free(d->vbios);
-		}
-
-		if (d->path != NULL) {
-			free(d->path);
+		if (!strcasecmp("--help", argv[i]) || !strcasecmp("-h", argv[i])) {
+			opt_help = true;
+			return true;
+		} else if (!strcasecmp("--biosonly", argv[i]) || !strcasecmp("-b", argv[i])) {
+			opt_format = OUTPUT_BIOS;
+		} else if (!strcasecmp("--short", argv[i]) || !strcasecmp("-s", argv[i])) {
+			if (opt_format != OUTPUT_BIOS)
+				opt_format = OUTPUT_SHORT;
+		} else if (!strcasecmp("--format", argv[i]) || !strcasecmp("-f", argv[i])) {
+			if (i + 1 >= argc || !output_parse_format(argv[i + 1], &opt_format)) {
+				print(LOG_ERROR, "%s requires one of text, short, bios, json or csv\n", argv[i]);
+				return false;
+			}
+			++i;
+		} else if (!strcasecmp("--fields", argv[i])) {
+			if (i + 1 >= argc || !output_parse_fields(argv[i + 1], &opt_fields)) {
+				print(LOG_ERROR, "%s requires a comma separated list of:", argv[i]);
+				for (j = 0; output_field_name(j) != NULL; ++j)
+					print(LOG_ERROR, " %s", output_field_name(j));
+				print(LOG_ERROR, "\n");
+				return false;
+			}
+			opt_fields_set = true;
+			++i;
+		} else if (!strcasecmp("--device", argv[i]) || !strcasecmp("--id", argv[i])) {
+			by_id = !strcasecmp("--id", argv[i]);
+			if (i + 1 >= argc || !parse_select(argv[i + 1], by_id, &sel)) {
+				print(LOG_ERROR, "%s requires %s\n", argv[i], by_id ? "a VVVV:DDDD ID" : "a PCI address like 0b:00.0");
+				return false;
+			}
+			if ((grown = realloc(opt_select, sizeof(sel) * (opt_select_count + 1))) == NULL) {
+				print(LOG_ERROR, "malloc() failed in load_options()\n");
+				return false;
+			}
+			opt_select = grown;
+			opt_select[opt_select_count++] = sel;
+			++i;
+		} else if (!strcasecmp("--jobs", argv[i]) || !strcasecmp("-j", argv[i])) {
+			if (i + 1 >= argc || !parse_number(argv[i + 1], 1, UINT_MAX, &n)) {
+				print(LOG_ERROR, "%s requires a positive number\n", argv[i]);
+				return false;
+			}
+			opt_jobs = (unsigned int)n;
+			++i;
+		} else if (!strcasecmp("--cache", argv[i])) {
+			if (i + 1 >= argc) {
+				print(LOG_ERROR, "%s requires a directory\n", argv[i]);
+				return false;
+			}
+			opt_cache_dir = argv[++i];
+		} else if (!strcasecmp("--no-cache", argv[i])) {
+			opt_cache_dir = NULL;
+		} else if (!strcasecmp("--prometheus", argv[i])) {
+			if (i + 1 >= argc) {
+				print(LOG_ERROR, "%s requires a file name\n", argv[i]);
+				return false;
+			}
+			opt_prometheus = argv[++i];
+			opt_format = OUTPUT_PROMETHEUS;
+		} else if (!strcasecmp("--sysfs", argv[i])) {
+			if (i + 1 >= argc) {
+				print(LOG_ERROR, "%s requires a directory\n", argv[i]);
+				return false;
+			}
+			opt_sysfs_path = argv[++i];
+		} else if (!strcasecmp("--libpci", argv[i])) {
+			opt_libpci = true;
+		} else if (!strcasecmp("--no-pci-ids", argv[i])) {
+			opt_pci_ids = false;
+		} else if (!strcasecmp("--analyze-roms", argv[i])) {
+			opt_analyze = &argv[i + 1];
+			while (i + 1 < argc && argv[i + 1][0] != '-') {
+				++opt_analyze_count;
+				++i;
+			}
+			if (opt_analyze_count == 0) {
+				print(LOG_ERROR, "%s requires directories or files\n", argv[i]);
+				return false;
+			}
+		} else if (!strcasecmp("--aggregate", argv[i])) {
+			opt_aggregate = &argv[i + 1];
+			while (i + 1 < argc && argv[i + 1][0] != '-') {
+				++opt_aggregate_count;
+				++i;
+			}
+			if (opt_aggregate_count == 0) {
+				print(LOG_ERROR, "%s requires directories or files\n", argv[i]);
+				return false;
+			}
+		} else if (!strcasecmp("--catalog", argv[i])) {
+			if (i + 1 >= argc) {
+				print(LOG_ERROR, "%s requires a file name\n", argv[i]);
+				return false;
+			}
+			opt_catalog = argv[++i];
+		} else if (!strcasecmp("--db", argv[i])) {
+			if (i + 1 >= argc) {
+				print(LOG_ERROR, "%s requires a file name\n", argv[i]);
+				return false;
+			}
+			opt_db = argv[++i];
+		} else if (!strcasecmp("--snapshot", argv[i]) || !strcasecmp("--diff", argv[i])) {
+			if (i + 1 >= argc) {
+				print(LOG_ERROR, "%s requires a file name\n", argv[i]);
+				return false;
+			}
+			if (!strcasecmp("--snapshot", argv[i]))
+				opt_snapshot = argv[++i];
+			else
+				opt_diff = argv[++i];
+		} else if (!strcasecmp("--watch", argv[i])) {
+			if (i + 1 >= argc || !parse_seconds(argv[i + 1], &opt_watch) ||
+			    opt_watch < TELEMETRY_MIN_INTERVAL) {
+				print(LOG_ERROR, "%s requires at least %g seconds\n", argv[i], TELEMETRY_MIN_INTERVAL);
+				return false;
+			}
+			++i;
+		} else if (!strcasecmp("--timeout", argv[i])) {
+			if (i + 1 >= argc || !parse_seconds(argv[i + 1], &opt_timeout) ||
+			    opt_timeout <= 0 || opt_timeout > 86400) {
+				print(LOG_ERROR, "%s requires a positive number of seconds\n", argv[i]);
+				return false;
+			}
+			++i;
+		} else if (!strcasecmp("--watch-samples", argv[i])) {
+			if (i + 1 >= argc || !parse_number(argv[i + 1], 1, ULONG_MAX, &opt_watch_samples)) {
+				print(LOG_ERROR, "%s requires a positive number\n", argv[i]);
+				return false;
+			}
+			++i;
+		} else if (!strcasecmp("--timings", argv[i])) {
+			opt_timings = true;
+		} else if (!strcasecmp("--record", argv[i]) || !strcasecmp("--replay", argv[i])) {
+			if (i + 1 >= argc) {
+				print(LOG_ERROR, "%s requires a trace file\n", argv[i]);
+				return false;
+			}
+			if (!strcasecmp("--record", argv[i]))
+				opt_record = argv[++i];
+			else
+				opt_replay = argv[++i];
+		} else if (!strcasecmp("--replay-latency", argv[i])) {
+			if (i + 1 >= argc || !parse_number(argv[i + 1], 0, UINT_MAX, &n)) {
+				print(LOG_ERROR, "%s requires a number of microseconds\n", argv[i]);
+				return false;
+			}
+			opt_replay_latency = (unsigned int)n;
+			++i;
+		} else {
+			print(LOG_ERROR, "Unknown option %s\n", argv[i]);
+			return false;
 		}
-
-		free((void *)d);
 	}
 
-	last_device = device_list = NULL;
+	return true;
 }
 
-/***********************************************
- * VBIOS functions
- ***********************************************/
-static size_t dump_vbios(gpu_t *gpu)
+/*
+ * Find all suitable cards, then find their memory space and get memory information.
+ */
+int main(int argc, char *argv[])
 {
-	size_t success = 0;
-	char obj[1024];
-	FILE *fp;
+	amdgpuinfo_config_t config;
+	amdgpuinfo_t *ctx;
+	fp_catalog_t *catalog = NULL;
+	hwio_t *hw;
+	const gpu_t *d;
+	int fail=0;
+	bool found = false;
+	output_t out;
+	char tmp[1100];
+	int fd, ret = 0;
+	long changes;
+	uint64_t run_time[TIME_RUN_PHASES];
+	uint64_t start = timing_now(), t;
 
-	sprintf(obj, "%s/rom", gpu->path);
+	if (!load_options(argc, argv)) {
+		return EXIT_FAILURE;
+	}
 
-	//unlock vbios
-	if ((fp = fopen(obj, "w")) == NULL) {
-		print(LOG_ERROR, "%02x:%02x.%x: Unable to unlock vbios (try running as root)\n", gpu->pcibus, gpu->pcidev, gpu->pcifunc);
+	if (opt_help) {
+		showhelp(argv[0]);
 		return 0;
 	}
 
-	fputs("1\n", fp);
-	fclose(fp);
+	print(LOG_INFO, NAME " v" VERSION "\n");
 
-	//if vbios buffer in use, free it
-	if (gpu->vbios != NULL) {
-		free(gpu->vbios);
+	// an explicit database has to load, the default one is optional
+	if (opt_db != NULL) {
+		if (!gpudb_load(opt_db)) {
+			print(LOG_ERROR, "Unable to load device database %s\n", opt_db);
+			return 1;
+		}
+	} else if (gpudb_load(GPUDB_PATH)) {
+		opt_db = GPUDB_PATH;
 	}
 
-	//allocate 64k for vbios - could be larger but for now only read 64k
-	if ((gpu->vbios = (unsigned char *)malloc(0x10000)) == NULL) {
-		print(LOG_ERROR, "%02x:%02x.%x: Unable to allocate memory for vbios\n", gpu->pcibus, gpu->pcidev, gpu->pcifunc);
-		goto relock;
+	if (opt_catalog != NULL && (catalog = fingerprint_catalog_load(opt_catalog)) == NULL) {
+		print(LOG_ERROR, "Unable to load VBIOS catalog %s: %s\n", opt_catalog, strerror(errno));
+		gpudb_unload();
+		return 1;
 	}
 
-	//read vbios into buffer
-	if ((fp = fopen(obj, "r")) == NULL) {
-		print(LOG_ERROR, "%02x:%02x.%x: Unable to read vbios\n", gpu->pcibus, gpu->pcidev, gpu->pcifunc);
-		free(gpu->vbios);
-		goto relock;
-	}
+	// dumps on disk need neither libpci nor the hardware
+	if (opt_analyze != NULL) {
+		long count;
+
+		if (opt_format == OUTPUT_PROMETHEUS) {
+			print(LOG_ERROR, "--analyze-roms does not support the prometheus format\n");
+			return 1;
+		}
+
+		// records bypass stdio, the banner has to go out first
+		fflush(stdout);
+		t = timing_now();
+		count = analyze_roms(opt_analyze, opt_analyze_count, opt_jobs, catalog, opt_format, STDOUT_FILENO);
+		fingerprint_catalog_free(catalog);
 
-	success = fread(gpu->vbios, 0x10000, 1, fp);
-	fclose(fp);
+		if (count < 0) {
+			print(LOG_ERROR, "Unable to list VBIOS images: %s\n", strerror(errno));
+			return 1;
+		}
 
-	//temp fix some gpus returned less than 64k...
-	success = 1;
+		print(LOG_INFO, "Analyzed %ld VBIOS images in %.1f ms\n", count, (double)(timing_now() - t) / 1e6);
 
-relock:
-	//relock vbios
-	if ((fp = fopen(obj, "w")) == NULL) {
-		print(LOG_ERROR, "%02x:%02x.%x: Unable to relock vbios\n", gpu->pcibus, gpu->pcidev, gpu->pcifunc);
 		return 0;
 	}
 
-	fputs("0\n", fp);
-	fclose(fp);
+	// so do saved outputs
+	if (opt_aggregate != NULL) {
+		long count;
 
-	return success;
-}
+		if (opt_format == OUTPUT_PROMETHEUS) {
+			print(LOG_ERROR, "--aggregate does not support the prometheus format\n");
+			return 1;
+		}
 
-#define rbios8(vbios, offset) *((u8 *)(vbios)+(offset))
-#define rbios16(vbios, offset) *((u16 *)((vbios)+(offset)))
-#define rbios32(vbios, offset) *((u32 *)((vbios)+(offset)))
+		fflush(stdout);
+		t = timing_now();
+		count = aggregate_files(opt_aggregate, opt_aggregate_count, opt_jobs, opt_format, STDOUT_FILENO);
 
-static void get_bios_version(gpu_t *gpu)
-{
-	char c, *p, *v;
-	u16 ver_offset = rbios16(gpu->vbios, 0x6e);
-	int len;
+		if (count < 0) {
+			print(LOG_ERROR, "Unable to aggregate: %s\n", strerror(errno));
+			return 1;
+		}
 
-	v = gpu->bios_version;
-	memset(v, 0, 64);
+		print(LOG_INFO, "Aggregated %ld files in %.1f ms\n", count, (double)(timing_now() - t) / 1e6);
 
-	//check for invalid vbios
-	if (*((u16 *)gpu->vbios) != 0xaa55) {
-		return;
+		return 0;
 	}
 
-	p = (char *)(gpu->vbios+ver_offset);
-	len = 0;
-
-	while (((c = *(p++)) != 0) && len < 63) {
-		*(v++) = c;
-		++len;
+	if (opt_diff != NULL && opt_format == OUTPUT_PROMETHEUS) {
+		print(LOG_ERROR, "--diff does not support the prometheus format\n");
+		return 1;
 	}
-}
 
-/*
- * Check if a device is an APU
- */
-static bool is_apu(struct pci_access *pci, struct pci_dev *pcidev)
-{
-	bool is_apu = false;
-	regex_t regex;
-	char buf[1024];
+	if (opt_fields_set && (opt_format == OUTPUT_PROMETHEUS || opt_diff != NULL || opt_watch > 0)) {
+		print(LOG_ERROR, "--fields does not work with --diff, --watch or the prometheus format\n");
+		return 1;
+	}
 
-	memset(buf, 0, 1024);
+	if (opt_watch > 0 && (opt_format == OUTPUT_PROMETHEUS || opt_replay != NULL || opt_diff != NULL)) {
+		print(LOG_ERROR, "--watch does not work with --diff, --replay or the prometheus format\n");
+		return 1;
+	}
 
-	if (pci_lookup_name(pci, buf, sizeof(buf), PCI_LOOKUP_DEVICE, pcidev->vendor_id, pcidev->device_id) != NULL) {
-		if (regcomp(&regex, "(Kaveri|Beavercreek|Sumo|Wrestler|Kabini|Mullins|Temash|Trinity|Richland|Stoney|Carrizo|Raven)", REG_ICASE | REG_EXTENDED) == 0) {
-			if (regexec(&regex, buf, 0, NULL, 0) == 0) {
-				is_apu = true;
-			}
+	if (opt_replay != NULL) {
+		if ((hw = hwio_replay(opt_replay)) == NULL) {
+			print(LOG_ERROR, "Unable to load trace %s\n", opt_replay);
+			return 1;
+		}
+		hwio_replay_latency(hw, opt_replay_latency);
+	} else if (opt_record != NULL) {
+		if ((hw = hwio_record(opt_record)) == NULL) {
+			print(LOG_ERROR, "Unable to create trace %s: %s\n", opt_record, strerror(errno));
+			return 1;
 		}
+	} else {
+		hw = hwio_real();
 	}
 
-	regfree(&regex);
-
-	return is_apu;
-}
-
-/*
- * Find all suitable cards, then find their memory space and get memory information.
- */
-int main(int argc, char *argv[])
-{
-	gpu_t *d;
-	struct pci_access *pci;
-	struct pci_dev *pcidev;
-	int i, meminfo, manufacturer, model, mem_type, fd;
-	char buf[1024];
-	off_t base;
-	int *pcimem;
-	int fail=0;
-	bool found = false;
-
-	if (!load_options(argc, argv)) {
-		return 0;
+	amdgpuinfo_config_init(&config);
+	config.sysfs_path = opt_sysfs_path;
+	config.cache_dir = opt_cache_dir;
+	config.jobs = opt_jobs;
+	config.timeout_ms = opt_timeout > 0 && opt_timeout < 0.001 ? 1 : (unsigned int)(opt_timeout * 1000);
+	config.libpci = opt_libpci;
+	config.pci_ids = opt_pci_ids;
+	config.hw = hw;
+	config.catalog = catalog;
+	config.log = vprint;
+	config.select = opt_select;
+	config.nselect = opt_select_count;
+
+	// probe only what ends up somewhere, the rest would only cost time and privileges
+	if (opt_watch > 0)
+		config.probes = 0;
+	else if (opt_diff != NULL)
+		config.probes = AMDGPUINFO_PROBE_VBIOS | AMDGPUINFO_PROBE_MEMORY;
+	else
+		config.probes = output_probes(opt_format, opt_fields_set ? &opt_fields : NULL);
+
+	if (opt_snapshot != NULL)
+		config.probes |= AMDGPUINFO_PROBE_VBIOS | AMDGPUINFO_PROBE_MEMORY;
+
+	if ((ctx = amdgpuinfo_new(&config)) == NULL) {
+		print(LOG_ERROR, "malloc() failed in main()\n");
+		hwio_close(hw);
+		gpudb_unload();
+		return 1;
 	}
 
-	print(LOG_INFO, NAME " v" VERSION "\n");
-
-	pci = pci_alloc();
-	pci_init(pci);
-	pci_scan_bus(pci);
-
-	char *sysfs_path = pci_get_param(pci, "sysfs.path");
+	amdgpuinfo_enumerate(ctx);
 
-	for (pcidev = pci->devices; pcidev; pcidev = pcidev->next)
-	{
-		if (((pcidev->device_class & 0xff00) >> 8) == PCI_BASE_CLASS_DISPLAY && pcidev->vendor_id == AMD_PCI_VENDOR_ID) {
-
-			// skip APUs
-			if (is_apu(pci, pcidev))
-				continue;
-
-			if ((d = new_device()) != NULL) {
-				d->vendor_id = AMD_PCI_VENDOR_ID;
-				d->device_id = pcidev->device_id;
-				d->pcibus = pcidev->bus;
-				d->pcidev = pcidev->dev;
-				d->pcifunc = pcidev->func;
-				d->subvendor = pci_read_word(pcidev, PCI_SUBSYSTEM_VENDOR_ID);
-				d->subdevice = pci_read_word(pcidev, PCI_SUBSYSTEM_ID);
-				d->pcirev = pci_read_byte(pcidev, PCI_REVISION_ID);
-
-				memset(buf, 0, 1024);
-				sprintf(buf, "%s/devices/%04x:%02x:%02x.%d", sysfs_path, pcidev->domain, pcidev->bus, pcidev->dev, pcidev->func);
-				d->path = strdup(buf);
-
-
-				d->gpu = find_gpu(pcidev->device_id, d->subdevice, d->pcirev);
-				if (!d->gpu) {
-					printf("AMD card found, but model not found.\n");
-					continue;
-				} else {
-					found = true;
-				}
-
-				if (dump_vbios(d))
-					get_bios_version(d);
-
-				//currenty Vega GPUs do not have a memory configuration register to read
-				if ((d->gpu->asic_type == CHIP_VEGA10) ||
-				(d->gpu->asic_type == CHIP_VEGA20)) {
-					d->memconfig = 0x61000000;
-					d->mem_type = MEM_HBM;
-					d->mem_manufacturer = 1;
-					d->mem_model = 0;
-					d->mem = find_mem(MEM_HBM, 1, 0);
-				} else {
-					for (i=6;--i;) {
-						if (pcidev->size[i] == 0x40000) {
-							base = (pcidev->base_addr[i] & 0xfffffff0);
-							fd = open("/dev/mem", O_RDONLY);
-
-							if ((pcimem = (int *)mmap(NULL, 0x20000, PROT_READ, MAP_SHARED, fd, base)) != MAP_FAILED) {
-								if (d->gpu->asic_type == CHIP_FIJI) {
-									meminfo = pcimem[mmMC_SEQ_MISC0_FIJI];
-								} else {
-									meminfo = pcimem[mmMC_SEQ_MISC0];
-								}
-
-							mem_type = (meminfo & 0xf0000000) >> 28;
-							manufacturer = (meminfo & 0xf00) >> 8;
-							model = (meminfo & 0xf000) >> 12;
-
-							d->memconfig = meminfo;
-							d->mem_type = mem_type;
-							d->mem_manufacturer = manufacturer;
-							d->mem_model = model;
-							d->mem = find_mem(mem_type, manufacturer, model);
-
-							munmap(pcimem, 0x20000);
-						} else {
-							++fail;
-						}
-
-						close(fd);
-
-						// memory model found so exit loop
-						if (d->mem != NULL)
-							break;
-						}
-					}
-				}
-			}
-		}
+	for (d = amdgpuinfo_devices(ctx); d; d = d->next) {
+		if (d->gpu)
+			found = true;
+		if (d->mmio_failed)
+			++fail;
 	}
 
-	pci_cleanup(pci);
+	t = timing_now();
 
 	//display info
-	d = device_list;
-	while (d)
-	{
-		//if bios version is blank, replace it with BLANK_BIOS_VER
-		if (d->bios_version[0] == 0) {
-			strcpy(d->bios_version, BLANK_BIOS_VER);
+	if (opt_watch > 0) {
+		fflush(stdout);
+		if (telemetry_watch(amdgpuinfo_devices(ctx), opt_watch, opt_watch_samples, opt_format, STDOUT_FILENO) < 0) {
+			print(LOG_ERROR, "Unable to sample telemetry\n");
+			ret = 1;
 		}
-
-		// short form
-		if (opt_output_short) {
-
-			printf("GPU:");
-
-			//only output bios version
-			if (opt_bios_only) {
-				printf("%s\n", d->bios_version);
-			}
-			//standard short form
-			else {
-				printf("%02x.%02x.%x:", d->pcibus, d->pcidev, d->pcifunc);
-
-				if (d->gpu) {
-					printf("%s:", d->gpu->name);
-				} else {
-					printf("Unknown GPU %04x-%04xr%02x:",d->vendor_id, d->device_id, d->pcirev);
-				}
-
-				printf("%s:", d->bios_version);
-
-				printf("0x%x:", d->memconfig);
-
-				if (d->mem && d->mem->manufacturer != 0) {
-					printf("%s:%s:", d->mem->name, mem_type_label[d->mem->type]);
-				} else {
-					printf("Unknown Memory %d-%d:%s:", d->mem_manufacturer, d->mem_model, mem_type_label[0]);
-				}
-
-				printf("%s", amd_asic_name[d->gpu->asic_type]);
-
-				printf("\n");
-			}
-		// long form (original)
+	} else if (opt_diff != NULL) {
+		// like diff(1): 0 when nothing changed, 1 when something did, 2 on trouble
+		fflush(stdout);
+		if ((changes = snapshot_diff(opt_diff, amdgpuinfo_devices(ctx), opt_format, STDOUT_FILENO)) < 0) {
+			print(LOG_ERROR, "Unable to read snapshot %s: %s\n", opt_diff, strerror(errno));
+			ret = 2;
+		} else if (changes > 0) {
+			ret = 1;
+		}
+	} else if (opt_prometheus != NULL) {
+		if ((fd = output_open_atomic(opt_prometheus, tmp, sizeof(tmp))) < 0) {
+			print(LOG_ERROR, "Unable to create %s: %s\n", tmp, strerror(errno));
+			ret = 1;
 		} else {
-			if (d->gpu) {
-
-				char subsystem[256];
-				pci_lookup_name(pci, subsystem, sizeof(subsystem),
-					PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR,
-					d->subvendor);
-
-				printf(	"-----------------------------------\n"
-					"Found Card: %04x:%04x rev %02x (AMD %s)\n"
-					"Chip Type: %s\n"
-					"BIOS Version: %s\n"
-					"PCI: %02x:%02x.%x\n"
-					"Subvendor:  0x%04x\n"
-					"Subdevice:  0x%04x\n"
-					"Subsystem: %s\n"
-					"Sysfs Path: %s\n",
-					AMD_PCI_VENDOR_ID, d->gpu->device_id, d->pcirev, d->gpu->name,
-					amd_asic_name[d->gpu->asic_type], d->bios_version,
-					d->pcibus, d->pcidev, d->pcifunc,
-					d->subvendor, d->subdevice, subsystem,
-					d->path);
-
-				printf("Memory Configuration: 0x%x\n", d->memconfig);
-
-				printf("Memory Model: ");
-
-				if (d->mem && d->mem->manufacturer != 0) {
-					printf("%s:%s:", d->mem->name, mem_type_label[d->mem->type]);
-				} else {
-					printf("Unknown Memory - Mfr:%d Model:%d\n", d->mem_manufacturer, d->mem_model);
-				}
-			}
-			else {
-				printf(	"-----------------------------------\n"
-					"Unknown card: %04x:%04x rev %02x\n"
-					"PCI: %02x:%02x.%x\n"
-					"Subvendor:  0x%04x\n"
-					"Subdevice:  0x%04x\n",
-					d->vendor_id, d->device_id, d->pcirev,
-					d->pcibus, d->pcidev, d->pcifunc,
-					d->subvendor, d->subdevice);
+			output_begin(&out, OUTPUT_PROMETHEUS, NULL, fd);
+			for (d = amdgpuinfo_devices(ctx); d; d = d->next)
+				output_device(&out, d);
+			if (!output_end(&out) || !output_commit_atomic(fd, tmp, opt_prometheus)) {
+				print(LOG_ERROR, "Unable to write %s\n", opt_prometheus);
+				ret = 1;
 			}
 		}
+	} else {
+		output_begin(&out, opt_format, opt_fields_set ? &opt_fields : NULL, STDOUT_FILENO);
+		for (d = amdgpuinfo_devices(ctx); d; d = d->next)
+			output_device(&out, d);
+		output_end(&out);
+	}
 
-		d = d->next;
+	// saved after the diff, so --diff FILE --snapshot FILE rolls FILE forward
+	if (opt_snapshot != NULL && !snapshot_save(opt_snapshot, amdgpuinfo_devices(ctx))) {
+		print(LOG_ERROR, "Unable to write snapshot %s: %s\n", opt_snapshot, strerror(errno));
+		ret = opt_diff ? 2 : 1;
 	}
 
-	free_devices();
+	memcpy(run_time, amdgpuinfo_timings(ctx), sizeof(run_time));
+	run_time[TIME_OUTPUT] = timing_now() - t;
+	run_time[TIME_TOTAL] = timing_now() - start;
+
+	if (opt_timings)
+		output_timings(STDERR_FILENO, opt_format, run_time, amdgpuinfo_devices(ctx));
+
+	amdgpuinfo_free(ctx);
+	fingerprint_catalog_free(catalog);
+	free(opt_select);
+	hwio_close(hw);
+	gpudb_unload();
 
 	if (!found)
-		printf("No AMD Graphic Card found\n");
+		print(LOG_INFO, "No AMD Graphic Card found\n");
 
 	if (fail) {
 		print(LOG_ERROR, "Direct PCI access failed. Run AMDGPUInfo as root to get memory type information!\n");
 	}
 
-	return 0;
+	return ret;
 }
-
@@ -0,0 +1,118 @@
+/*
+ * AMDGPUInfo - probing library
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef AMDGPUINFO_H
+#define AMDGPUINFO_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fingerprint.h"
+#include "gpu.h"
+#include "hwio.h"
+#include "timing.h"
+
+/*
+ * Everything the amdgpuinfo tool knows about the GPUs of a machine,
+ * behind a context handle. Contexts share nothing, so each thread can
+ * have its own, and a long running process can keep one and call
+ * amdgpuinfo_enumerate() again whenever it wants fresh results: libpci
+ * is only brought up when it is needed, and stays up.
+ *
+ * The device tables are process wide, gpudb_load() has to be done
+ * before the first context is created.
+ */
+typedef struct amdgpuinfo amdgpuinfo_t;
+
+enum {
+	AMDGPUINFO_LOG_INFO = 1,
+	AMDGPUINFO_LOG_ERROR = 2,
+};
+
+/*
+ * What is found out about each device on top of its IDs and table
+ * entry, which come for free. Every probe left out spares the hardware
+ * access, and often the root privileges, it needs.
+ */
+enum {
+	AMDGPUINFO_PROBE_VBIOS = 1 << 0,	// bios_version and fingerprint, reads the ROM
+	AMDGPUINFO_PROBE_MEMORY = 1 << 1,	// mem* fields, from the registers or the ROM, whichever the ASIC has
+	AMDGPUINFO_PROBE_NAMES = 1 << 2,	// subsystem, built in or from pci.ids
+	AMDGPUINFO_PROBE_ALL = 0x7,
+};
+
+/*
+ * Limits the enumeration to some devices, one selector names either a
+ * PCI address or a vendor:device ID pair. When every selector is an
+ * address, their sysfs directories are opened directly, without
+ * listing the bus.
+ */
+typedef struct {
+	bool by_id;
+	int domain, bus, dev, func;
+	unsigned int vendor_id, device_id;
+} amdgpuinfo_select_t;
+
+typedef void (*amdgpuinfo_log_fn_t)(void *data, int level, const char *fmt, va_list args);
+
+typedef struct {
+	const char *sysfs_path;	// NULL for /sys/bus/pci
+	const char *cache_dir;	// NULL to never use the probe cache
+	unsigned int jobs;	// devices probed in parallel, 0 for one per CPU
+	unsigned int timeout_ms; // per device probe deadline, 0 for none, see below
+	bool libpci;		// enumerate with a libpci bus scan, not sysfs
+	bool pci_ids;		// look up names missing from the built-in table in pci.ids, on by default
+	unsigned int probes;	// AMDGPUINFO_PROBE_* flags, VBIOS and MEMORY by default
+	const amdgpuinfo_select_t *select; // devices matching any of these, NULL for all, must outlive the context
+	size_t nselect;
+	hwio_t *hw;		// NULL for the real hardware, must outlive the context
+	const fp_catalog_t *catalog; // known good VBIOS images, NULL to only verify checksums
+	amdgpuinfo_log_fn_t log; // NULL to stay quiet
+	void *log_data;
+} amdgpuinfo_config_t;
+
+void amdgpuinfo_config_init(amdgpuinfo_config_t *config);
+
+/*
+ * With timeout_ms, each device is probed on a thread of its own. A
+ * device that misses the deadline keeps what was found so far, with
+ * gpu_t.timed_out set, and the thread is left behind until the
+ * hardware lets go of it. It owns everything it uses and logs nothing
+ * from then on. Traces do not hang, they are probed without deadline.
+ *
+ * The ROM of a device that timed out is disabled again right away, but
+ * a thread stuck inside the read holds on to it until it returns. The
+ * deadline starts when a worker picks the device up, not with the run:
+ * with fewer jobs than devices, a run where every device hangs takes up
+ * to ceil(devices / jobs) * timeout_ms.
+ */
+
+amdgpuinfo_t *amdgpuinfo_new(const amdgpuinfo_config_t *config);
+void amdgpuinfo_free(amdgpuinfo_t *ctx);
+
+/*
+ * Drop the previous results, then find and probe all discrete AMD GPUs.
+ * Returns the number of devices, or -1 if they could not be listed.
+ */
+int amdgpuinfo_enumerate(amdgpuinfo_t *ctx);
+
+// devices of the last enumeration, in PCI order
+size_t amdgpuinfo_count(const amdgpuinfo_t *ctx);
+const gpu_t *amdgpuinfo_device(const amdgpuinfo_t *ctx, size_t index);
+const gpu_t *amdgpuinfo_devices(const amdgpuinfo_t *ctx); // first of the ->next list
+
+// probe one device again, skipping the cache
+bool amdgpuinfo_refresh(amdgpuinfo_t *ctx, size_t index);
+
+// fill in gpu_t.subsystem, AMDGPUINFO_PROBE_NAMES does it on enumeration
+void amdgpuinfo_lookup_names(amdgpuinfo_t *ctx);
+
+// TIME_RUN_PHASES entries, ns spent in each phase so far
+const uint64_t *amdgpuinfo_timings(const amdgpuinfo_t *ctx);
+
+#endif
@@ -0,0 +1,223 @@
+/*
+ * AMDGPUInfo - offline VBIOS image analysis
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analyze.h"
+#include "atom.h"
+#include "filelist.h"
+#include "fingerprint.h"
+#include "gpudb.h"
+#include "pool.h"
+#include "rom.h"
+
+typedef struct {
+	char *const *files;
+	output_format_t format;
+	const fp_catalog_t *catalog;
+	rom_t *roms;		// one per worker
+	outbuf_t *bufs;		// one per worker
+	pthread_mutex_t lock;	// serializes records on fd
+	int fd;
+	size_t written;
+} analyze_t;
+
+/***********************************************
+ * Records
+ ***********************************************/
+static const char *status_name(int ret)
+{
+	switch (ret) {
+	case ROM_OK:
+		return "ok";
+	case ROM_SHORT:
+		return "short";
+	case ROM_ERR_OPEN:
+		return "unreadable";
+	case ROM_ERR_INVALID:
+		return "invalid";
+	case ROM_ERR_NOMEM:
+		return "nomem";
+	default:
+		return "error";
+	}
+}
+
+// "GDDR5 Samsung/SK Hynix", every strap's memory, each listed once
+static void describe_memory(const rom_t *rom, char *buf, size_t len)
+{
+	atom_vram_module_t modules[ATOM_MAX_VRAM_MODULES];
+	unsigned int seen_types = 0, seen_vendors = 0;
+	size_t i, n, used = 0;
+	atom_t atom;
+
+	buf[0] = 0;
+
+	if (!atom_init(&atom, rom) ||
+	    (n = atom_vram_modules(&atom, modules, ATOM_MAX_VRAM_MODULES)) == 0)
+		return;
+
+	for (i = 0; i < n && used < len; ++i)
+	{
+		if (seen_types & (1u << modules[i].type))
+			continue;
+		seen_types |= 1u << modules[i].type;
+		used += (size_t)snprintf(buf + used, len - used, "%s%s", used ? "/" : "", mem_type_name(modules[i].type));
+	}
+
+	for (i = 0; i < n && used < len; ++i)
+	{
+		if (seen_vendors & (1u << modules[i].vendor))
+			continue;
+		used += (size_t)snprintf(buf + used, len - used, "%s%s", seen_vendors ? "/" : " ", mem_vendor_name(modules[i].vendor));
+		seen_vendors |= 1u << modules[i].vendor;
+	}
+}
+
+static void analyze_record(outbuf_t *out, output_format_t format, const char *path,
+			   int ret, const rom_t *rom, const char *version, const char *memory,
+			   const fingerprint_t *fp, int fp_status)
+{
+	char rom_hash[17] = "", timing_hash[17] = "";
+
+	if (fp->valid) {
+		snprintf(rom_hash, sizeof(rom_hash), "%016llx", (unsigned long long)fp->rom_hash);
+		snprintf(timing_hash, sizeof(timing_hash), "%016llx", (unsigned long long)fp->timing_hash);
+	}
+
+	switch (format) {
+	case OUTPUT_JSON:
+		outbuf_puts(out, "{\"file\": ");
+		outbuf_json_string(out, path);
+		outbuf_printf(out, ", \"status\": \"%s\", \"size\": %zu, \"expected\": %zu, \"bios_version\": ",
+			      status_name(ret), rom->size, rom->expected);
+		outbuf_json_string(out, version);
+		outbuf_puts(out, ", \"memory\": ");
+		outbuf_json_string(out, memory);
+		outbuf_printf(out, ", \"rom_hash\": \"%s\", \"timing_hash\": \"%s\", \"rom_status\": \"%s\"}",
+			      rom_hash, timing_hash, fingerprint_status_name(fp_status));
+		break;
+	case OUTPUT_CSV:
+		outbuf_csv_string(out, path);
+		outbuf_printf(out, ",%s,%zu,%zu,", status_name(ret), rom->size, rom->expected);
+		outbuf_csv_string(out, version);
+		outbuf_puts(out, ",");
+		outbuf_csv_string(out, memory);
+		outbuf_printf(out, ",%s,%s,%s\n", rom_hash, timing_hash, fingerprint_status_name(fp_status));
+		break;
+	case OUTPUT_SHORT:
+	case OUTPUT_BIOS:
+		outbuf_printf(out, "%s:%s:%s\n", path, version, memory);
+		break;
+	default:
+		if (ret != ROM_OK && ret != ROM_SHORT) {
+			outbuf_printf(out, "%s: %s\n", path, status_name(ret));
+			break;
+		}
+		outbuf_printf(out, "%s: %s, %zu bytes%s%s%s, hash %s (%s)\n", path, version[0] ? version : "no version",
+			      rom->size, ret == ROM_SHORT ? " (short)" : "",
+			      memory[0] ? ", " : "", memory, rom_hash, fingerprint_status_name(fp_status));
+		break;
+	}
+}
+
+static void analyze_file(void *arg, size_t index, unsigned int worker)
+{
+	analyze_t *a = arg;
+	rom_t *rom = &a->roms[worker];
+	outbuf_t *out = &a->bufs[worker];
+	char version[64], memory[128];
+	fingerprint_t fp;
+	int ret, fp_status;
+
+	version[0] = memory[0] = 0;
+	memset(&fp, 0, sizeof(fp));
+
+	if ((ret = rom_read_file(rom, a->files[index])) == ROM_OK || ret == ROM_SHORT) {
+		rom_get_version(rom, version, sizeof(version));
+		describe_memory(rom, memory, sizeof(memory));
+		fingerprint_rom(&fp, rom);
+	}
+
+	fp_status = fingerprint_check(a->catalog, version, &fp);
+
+	// records from all workers share fd, keep each one whole
+	pthread_mutex_lock(&a->lock);
+	if (a->format == OUTPUT_JSON)
+		outbuf_puts(out, a->written ? ",\n  " : "\n  ");
+	analyze_record(out, a->format, a->files[index], ret, rom, version, memory, &fp, fp_status);
+	outbuf_flush(out);
+	++a->written;
+	pthread_mutex_unlock(&a->lock);
+
+	// drop the mapping now rather than when this worker gets its next file
+	rom_release(rom);
+}
+
+long analyze_roms(char *const *paths, size_t count, unsigned int jobs,
+		  const fp_catalog_t *catalog, output_format_t format, int fd)
+{
+	file_list_t list = { NULL, 0, 0 };
+	unsigned int workers, i;
+	outbuf_t head;
+	analyze_t a;
+	long ret = -1;
+
+	if (!file_list_paths(&list, paths, count))
+		goto out;
+
+	workers = pool_workers(jobs, list.count);
+	a.files = list.files;
+	a.format = format;
+	a.catalog = catalog;
+	a.fd = fd;
+	a.written = 0;
+	a.roms = calloc(workers ? workers : 1, sizeof(rom_t));
+	a.bufs = calloc(workers ? workers : 1, sizeof(outbuf_t));
+	if (a.roms == NULL || a.bufs == NULL) {
+		free(a.roms);
+		free(a.bufs);
+		goto out;
+	}
+
+	for (i = 0; i < workers; ++i)
+		outbuf_init(&a.bufs[i], fd);
+	pthread_mutex_init(&a.lock, NULL);
+
+	outbuf_init(&head, fd);
+	if (format == OUTPUT_JSON)
+		outbuf_puts(&head, "[");
+	else if (format == OUTPUT_CSV)
+		outbuf_puts(&head, "file,status,size,expected,bios_version,memory,rom_hash,timing_hash,rom_status\n");
+	outbuf_flush(&head);
+
+	pool_run(workers, list.count, analyze_file, &a);
+
+	if (format == OUTPUT_JSON)
+		outbuf_puts(&head, a.written ? "\n]\n" : "]\n");
+	outbuf_flush(&head);
+	outbuf_free(&head);
+
+	for (i = 0; i < workers; ++i)
+	{
+		rom_free(&a.roms[i]);
+		outbuf_free(&a.bufs[i]);
+	}
+	free(a.roms);
+	free(a.bufs);
+	pthread_mutex_destroy(&a.lock);
+
+	ret = (long)list.count;
+
+out:
+	file_list_free(&list);
+
+	return ret;
+}
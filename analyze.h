@@ -0,0 +1,25 @@
+/*
+ * AMDGPUInfo - offline VBIOS image analysis
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include <stddef.h>
+
+#include "fingerprint.h"
+#include "output.h"
+
+/*
+ * Analyze every VBIOS image in paths, directories are searched
+ * recursively. One record per image is written to fd as soon as it is
+ * done, so the order follows the workers, not the arguments. Images
+ * are fingerprinted and checked against catalog, if there is one.
+ * Returns the number of images looked at, or -1 on error.
+ */
+long analyze_roms(char *const *paths, size_t count, unsigned int jobs,
+		  const fp_catalog_t *catalog, output_format_t format, int fd);
+
+#endif
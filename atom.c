@@ -0,0 +1,209 @@
+/*
+ * AMDGPUInfo - ATOM BIOS tables
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Layouts follow atombios.h and atomfirmware.h from the amdgpu driver.
+ * Every read goes through the bounds checked rom_* accessors, so a
+ * damaged or hostile image can only make lookups fail.
+ */
+
+#include <string.h>
+
+#include "atom.h"
+
+#define ATOM_ROM_HEADER_PTR 0x48
+#define ATOM_ROM_SIGNATURE 0x04		// "ATOM" in the ROM header
+#define ATOM_ROM_COMMAND_DIR 0x1e
+#define ATOM_ROM_DATA_DIR 0x20
+
+// ATOM_COMMON_TABLE_HEADER in front of every table and directory
+#define ATOM_TABLE_SIZE 0x00
+#define ATOM_TABLE_FORMAT_REV 0x02
+#define ATOM_TABLE_CONTENT_REV 0x03
+#define ATOM_TABLE_HEADER_SIZE 4
+
+// firmwareinfo v3.1 and later (atomfirmware.h), atom_firmware_info_v3_1
+#define FIRMWARE_INFO_V3_SCRATCH_START 24
+
+// VRAM_Info v2.1/v2.2 (atombios.h), ATOM_VRAM_MODULE_V7/V8
+#define VRAM_V2_1_MODULE_COUNT 16
+#define VRAM_V2_1_MODULES 20
+#define VRAM_MODULE_V7_SIZE 4
+#define VRAM_MODULE_V7_TYPE 11
+#define VRAM_MODULE_V7_VENDOR 28
+
+// VRAM_Info v2.3/v2.4 (atomfirmware.h), atom_vram_module_v9/v10
+#define VRAM_V2_3_MODULE_COUNT 20
+#define VRAM_V2_3_MODULES 24
+#define VRAM_MODULE_V9_SIZE 20
+#define VRAM_MODULE_V9_TYPE 23
+#define VRAM_MODULE_V9_VENDOR 28
+
+static void atom_read_table(const rom_t *rom, uint16_t offset, atom_table_t *table)
+{
+	uint16_t size;
+	uint8_t frev, crev;
+
+	memset(table, 0, sizeof(*table));
+
+	if (offset == 0 ||
+	    !rom_u16(rom, offset + ATOM_TABLE_SIZE, &size) ||
+	    !rom_u8(rom, offset + ATOM_TABLE_FORMAT_REV, &frev) ||
+	    !rom_u8(rom, offset + ATOM_TABLE_CONTENT_REV, &crev))
+		return;
+
+	// the whole table has to be inside the image
+	if (size < ATOM_TABLE_HEADER_SIZE || (size_t)offset + size > rom->size)
+		return;
+
+	table->offset = offset;
+	table->size = size;
+	table->format_rev = frev;
+	table->content_rev = crev;
+}
+
+// find the ATOM ROM header, the tables are only indexed when first used
+bool atom_init(atom_t *atom, const rom_t *rom)
+{
+	uint32_t sig;
+
+	memset(atom, 0, sizeof(*atom));
+	atom->rom = rom;
+
+	if (!rom_u16(rom, ATOM_ROM_HEADER_PTR, &atom->header) ||
+	    !rom_u32(rom, atom->header + ATOM_ROM_SIGNATURE, &sig) ||
+	    memcmp(&sig, "ATOM", 4) != 0 ||
+	    !rom_u16(rom, atom->header + ATOM_ROM_COMMAND_DIR, &atom->command_dir) ||
+	    !rom_u16(rom, atom->header + ATOM_ROM_DATA_DIR, &atom->data_dir)) {
+		atom->header = 0;
+		return false;
+	}
+
+	return true;
+}
+
+// one pass over both directories
+static void atom_index(atom_t *atom)
+{
+	uint16_t offset;
+	unsigned int i;
+
+	atom->indexed = true;
+
+	if (atom->header == 0)
+		return;
+
+	for (i = 0; i < ATOM_DATA_TABLES; ++i)
+	{
+		if (rom_u16(atom->rom, atom->data_dir + ATOM_TABLE_HEADER_SIZE + 2 * i, &offset))
+			atom_read_table(atom->rom, offset, &atom->data[i]);
+	}
+
+	for (i = 0; i < ATOM_COMMAND_TABLES; ++i)
+	{
+		if (rom_u16(atom->rom, atom->command_dir + ATOM_TABLE_HEADER_SIZE + 2 * i, &offset))
+			atom_read_table(atom->rom, offset, &atom->command[i]);
+	}
+}
+
+const atom_table_t *atom_data_table(atom_t *atom, unsigned int index)
+{
+	if (index >= ATOM_DATA_TABLES)
+		return NULL;
+
+	if (!atom->indexed)
+		atom_index(atom);
+
+	return atom->data[index].offset ? &atom->data[index] : NULL;
+}
+
+const atom_table_t *atom_command_table(atom_t *atom, unsigned int index)
+{
+	if (index >= ATOM_COMMAND_TABLES)
+		return NULL;
+
+	if (!atom->indexed)
+		atom_index(atom);
+
+	return atom->command[index].offset ? &atom->command[index] : NULL;
+}
+
+/*
+ * Decode the memory modules listed in VRAM_Info. A board carries one
+ * entry per memory strap it was built with, the MC picks the right one
+ * at boot. Returns the number of modules stored, at most max.
+ */
+size_t atom_vram_modules(atom_t *atom, atom_vram_module_t *modules, size_t max)
+{
+	const atom_table_t *vram;
+	size_t count_offset, first, size_offset, type_offset, vendor_offset;
+	size_t offset, end, n = 0;
+	uint16_t size;
+	uint8_t count, type, vendor;
+
+	if ((vram = atom_data_table(atom, ATOM_DATA_VRAM_INFO)) == NULL || vram->format_rev != 2)
+		return 0;
+
+	switch (vram->content_rev) {
+	case 1:
+	case 2:
+		count_offset = VRAM_V2_1_MODULE_COUNT;
+		first = VRAM_V2_1_MODULES;
+		size_offset = VRAM_MODULE_V7_SIZE;
+		type_offset = VRAM_MODULE_V7_TYPE;
+		vendor_offset = VRAM_MODULE_V7_VENDOR;
+		break;
+	case 3:
+	case 4:
+		count_offset = VRAM_V2_3_MODULE_COUNT;
+		first = VRAM_V2_3_MODULES;
+		size_offset = VRAM_MODULE_V9_SIZE;
+		type_offset = VRAM_MODULE_V9_TYPE;
+		vendor_offset = VRAM_MODULE_V9_VENDOR;
+		break;
+	default:
+		return 0;
+	}
+
+	if (!rom_u8(atom->rom, vram->offset + count_offset, &count))
+		return 0;
+
+	offset = vram->offset + first;
+	end = (size_t)vram->offset + vram->size;
+
+	while (n < count && n < max)
+	{
+		// modules are variable sized, each one says how long it is
+		if (!rom_u16(atom->rom, offset + size_offset, &size) ||
+		    size <= vendor_offset || offset + size > end ||
+		    !rom_u8(atom->rom, offset + type_offset, &type) ||
+		    !rom_u8(atom->rom, offset + vendor_offset, &vendor))
+			break;
+
+		modules[n].type = type >> 4;
+		modules[n].vendor = vendor & 0xf;
+		modules[n].revision = vendor >> 4;
+		++n;
+
+		offset += size;
+	}
+
+	return n;
+}
+
+/*
+ * Dword index of BIOS_SCRATCH_0 in the register BAR, which atomfirmware
+ * images (Vega and later) give in FirmwareInfo. Older ones keep the
+ * scratch registers at a fixed place and do not say.
+ */
+bool atom_bios_scratch_start(atom_t *atom, uint32_t *start)
+{
+	const atom_table_t *info;
+
+	if ((info = atom_data_table(atom, ATOM_DATA_FIRMWARE_INFO)) == NULL || info->format_rev != 3 ||
+	    info->size < FIRMWARE_INFO_V3_SCRATCH_START + 4)
+		return false;
+
+	return rom_u32(atom->rom, info->offset + FIRMWARE_INFO_V3_SCRATCH_START, start) && *start != 0;
+}
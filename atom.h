@@ -0,0 +1,58 @@
+/*
+ * AMDGPUInfo - ATOM BIOS tables
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef ATOM_H
+#define ATOM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rom.h"
+
+// entries in the master data and command table directories
+#define ATOM_DATA_TABLES 34
+#define ATOM_COMMAND_TABLES 81
+
+// master data table indexes
+#define ATOM_DATA_FIRMWARE_INFO 4
+#define ATOM_DATA_VRAM_INFO 28
+
+#define ATOM_MAX_VRAM_MODULES 16
+
+typedef struct {
+	uint16_t offset;	// 0 when the table is absent
+	uint16_t size;
+	uint8_t format_rev, content_rev;
+} atom_table_t;
+
+/*
+ * Parsed view of a VBIOS image. Only the ROM header is looked at up
+ * front, the table directories are indexed on first use.
+ */
+typedef struct {
+	const rom_t *rom;
+	uint16_t header;	// ATOM_ROM_HEADER
+	uint16_t data_dir, command_dir;
+	bool indexed;
+	atom_table_t data[ATOM_DATA_TABLES];
+	atom_table_t command[ATOM_COMMAND_TABLES];
+} atom_t;
+
+typedef struct {
+	uint8_t type;		// high nibble of the memory type, MEM_*
+	uint8_t vendor;		// low nibble of the vendor/revision byte
+	uint8_t revision;	// its high nibble, the model in MC_SEQ_MISC0 terms
+} atom_vram_module_t;
+
+bool atom_init(atom_t *atom, const rom_t *rom);
+const atom_table_t *atom_data_table(atom_t *atom, unsigned int index);
+const atom_table_t *atom_command_table(atom_t *atom, unsigned int index);
+
+size_t atom_vram_modules(atom_t *atom, atom_vram_module_t *modules, size_t max);
+bool atom_bios_scratch_start(atom_t *atom, uint32_t *start);
+
+#endif
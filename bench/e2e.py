@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+#
+# AMDGPUInfo - end-to-end benchmark on a synthetic rig
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Usage: e2e.py [-j JOBS] [--latency USEC] amdgpuinfo trace.trace gpus sysfs
+#               [runs]
+#
+# Runs amdgpuinfo against a trace written by tools/gen-trace.py and
+# prints one JSON object: wall clock from exec to exit, which includes
+# loading the trace, and the run phases amdgpuinfo measures itself, so a
+# regression shows up as either startup or per device cost.
+#
+# A replayed read costs nothing by default. --latency makes each one
+# sleep, so comparing -j 1 with more jobs shows how much of the hardware
+# latency the worker pool hides.
+
+import argparse
+import json
+import statistics
+import subprocess
+import sys
+import time
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    # one job by default, so the per device cost does not depend on the core count
+    ap.add_argument('-j', '--jobs', type=int, default=1)
+    ap.add_argument('--latency', type=int, default=0)
+    ap.add_argument('binary')
+    ap.add_argument('trace')
+    ap.add_argument('gpus', type=int)
+    ap.add_argument('sysfs')
+    ap.add_argument('runs', type=int, nargs='?', default=10)
+    args = ap.parse_args()
+
+    binary, trace, gpus, sysfs, runs = args.binary, args.trace, args.gpus, args.sysfs, args.runs
+    cmd = [binary, '--replay', trace, '--sysfs', sysfs, '-j', str(args.jobs), '-f', 'json', '--timings']
+    name = 'e2e_%d' % gpus
+    if args.jobs != 1 or args.latency:
+        cmd += ['--replay-latency', str(args.latency)]
+        name += '_j%d_latency%d' % (args.jobs, args.latency)
+    walls, phases = [], []
+
+    for _ in range(runs):
+        start = time.perf_counter()
+        p = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+        walls.append((time.perf_counter() - start) * 1e3)
+
+        if p.returncode != 0:
+            sys.exit('%s exited with %d:\n%s' % (binary, p.returncode, p.stderr))
+        found = len(json.loads(p.stdout))
+        if found != gpus:
+            sys.exit('expected %d GPUs, found %d' % (gpus, found))
+
+        # the timings are the last thing on stderr
+        timings = json.loads(p.stderr[p.stderr.index('{"run"'):])
+        phases.append(timings['run'])
+
+    def median_ms(key):
+        return statistics.median(r[key] for r in phases) / 1e6
+
+    # everything before the devices are listed: exec, loading the trace, libpci
+    startup = statistics.median(r['total_ns'] - r['enumerate_ns'] - r['cache_ns'] - r['probe_ns'] -
+                                r['names_ns'] - r['output_ns'] for r in phases) / 1e6
+    probe = median_ms('probe_ns')
+    result = {
+        'benchmark': name,
+        'gpus': gpus,
+        'jobs': args.jobs,
+        'latency_us': args.latency,
+        'runs': runs,
+        'unit': 'ms',
+        'wall_min': round(min(walls), 3),
+        'wall_median': round(statistics.median(walls), 3),
+        'startup': round(startup, 3),
+        'enumerate': round(median_ms('enumerate_ns'), 3),
+        'probe': round(probe, 3),
+        'output': round(median_ms('output_ns'), 3),
+        'total': round(median_ms('total_ns'), 3),
+        'probe_per_device': round(probe / gpus, 4),
+    }
+
+    print(json.dumps(result, sort_keys=True))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,240 @@
+/*
+ * AMDGPUInfo - microbenchmarks
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Table lookups, VBIOS version parsing and output formatting, the
+ * parts of a run that do not depend on the hardware. Each benchmark
+ * prints one JSON object per line, the best of a few rounds, so results
+ * can be compared from one build to the next.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gpudb.h"
+#include "output.h"
+#include "rom.h"
+#include "timing.h"
+
+#define ROUNDS 5
+#define ROUND_NS 50000000ULL // long enough to drown the clock reads
+#define ROM_SIZE 0x10000
+#define DEVICES 16
+
+typedef void (*bench_fn_t)(void *arg, size_t iterations);
+
+// keeps the compiler from dropping lookups whose results are unused
+static volatile uintptr_t sink;
+
+// ns per call, best of ROUNDS, with the iteration count calibrated first
+static double run(bench_fn_t fn, void *arg, size_t *iterations)
+{
+	uint64_t t, best = 0;
+	size_t n = 1;
+	int i;
+
+	for (;;) {
+		t = timing_now();
+		fn(arg, n);
+		t = timing_now() - t;
+		if (t >= ROUND_NS / 10 || n >= ((size_t)1 << 40))
+			break;
+		n *= 2;
+	}
+
+	n = (size_t)((double)n * ROUND_NS / (double)(t ? t : 1)) + 1;
+
+	for (i = 0; i < ROUNDS; ++i) {
+		t = timing_now();
+		fn(arg, n);
+		t = timing_now() - t;
+		if (i == 0 || t < best)
+			best = t;
+	}
+
+	*iterations = n;
+
+	return (double)best / (double)n;
+}
+
+static void report(const char *name, bench_fn_t fn, void *arg)
+{
+	size_t iterations;
+	double ns = run(fn, arg, &iterations);
+
+	printf("{\"benchmark\": \"%s\", \"unit\": \"ns/op\", \"value\": %.2f, \"iterations\": %zu}\n",
+	       name, ns, iterations);
+	fflush(stdout);
+}
+
+/***********************************************
+ * Table lookups
+ ***********************************************/
+static void bench_find_gpu(void *arg, size_t iterations)
+{
+	const gputype_t *g;
+	size_t i;
+
+	(void)arg;
+
+	// every board in the table, then an ID that is in none of them
+	for (i = 0; i < iterations; ++i) {
+		if (i % (gputypes_count + 1) == gputypes_count) {
+			sink = (uintptr_t)find_gpu(0xffff, 0, 0);
+		} else {
+			g = &gputypes[i % (gputypes_count + 1)];
+			sink = (uintptr_t)find_gpu(g->device_id, g->subsys_id, g->rev_id);
+		}
+	}
+}
+
+static void bench_find_mem(void *arg, size_t iterations)
+{
+	size_t i;
+
+	(void)arg;
+
+	for (i = 0; i < iterations; ++i)
+		sink = (uintptr_t)find_mem((int)(i % 16), (int)(i / 16 % 17) - 1, (int)(i / 272 % 17) - 1);
+}
+
+static void bench_subvendor_name(void *arg, size_t iterations)
+{
+	size_t i;
+
+	(void)arg;
+
+	for (i = 0; i < iterations; ++i)
+		sink = (uintptr_t)subvendor_name(subvendors[i % subvendors_count].vendor_id + (i & 1));
+}
+
+/***********************************************
+ * VBIOS
+ ***********************************************/
+
+// just enough of an option ROM for rom_get_version()
+static unsigned char *make_rom(rom_t *rom)
+{
+	static const char version[] = "113-D0000000-000";
+	unsigned char *image;
+
+	if ((image = calloc(1, ROM_SIZE)) == NULL)
+		return NULL;
+
+	image[0] = 0x55;
+	image[1] = 0xaa;
+	image[2] = ROM_SIZE / 512;
+	image[0x6e] = 0x00;
+	image[0x6f] = 0x01;
+	memcpy(image + 0x100, version, sizeof(version));
+
+	rom_init(rom);
+	rom->data = image;
+	rom->size = rom->expected = ROM_SIZE;
+
+	return image;
+}
+
+static void bench_bios_version(void *arg, size_t iterations)
+{
+	char version[64];
+	size_t i;
+
+	for (i = 0; i < iterations; ++i) {
+		rom_get_version(arg, version, sizeof(version));
+		sink = (uintptr_t)version[0];
+	}
+}
+
+/***********************************************
+ * Output formatting
+ ***********************************************/
+typedef struct {
+	output_format_t format;
+	gpu_t *devices;
+	int fd;
+} format_bench_t;
+
+static void make_devices(gpu_t *devices)
+{
+	static char path[] = "/sys/bus/pci/devices/0000:01:00.0", subsystem[] = "XFX Pine Group Inc.";
+	const gputype_t *g;
+	size_t i;
+
+	memset(devices, 0, sizeof(gpu_t) * DEVICES);
+
+	for (i = 0; i < DEVICES; ++i) {
+		g = &gputypes[i * 7 % gputypes_count];
+		devices[i].vendor_id = AMD_PCI_VENDOR_ID;
+		devices[i].device_id = (u16)g->device_id;
+		devices[i].subvendor = 0x1682;
+		devices[i].subdevice = (u32)g->subsys_id;
+		devices[i].pcirev = g->rev_id;
+		devices[i].pcibus = (u8)(1 + i);
+		devices[i].gpu = g;
+		devices[i].memconfig = 0x50000600;
+		devices[i].mem_type = MEM_GDDR5;
+		devices[i].mem_manufacturer = 6;
+		devices[i].mem = find_mem(MEM_GDDR5, 6, 0);
+		devices[i].path = path;
+		devices[i].subsystem = subsystem;
+		snprintf(devices[i].bios_version, sizeof(devices[i].bios_version), "113-D%07zu-000", i);
+		devices[i].next = (i + 1 < DEVICES) ? &devices[i + 1] : NULL;
+	}
+}
+
+// one whole report of DEVICES GPUs per iteration, written to /dev/null
+static void bench_format(void *arg, size_t iterations)
+{
+	format_bench_t *b = arg;
+	output_t out;
+	const gpu_t *d;
+	size_t i;
+
+	for (i = 0; i < iterations; ++i) {
+		output_begin(&out, b->format, NULL, b->fd);
+		for (d = b->devices; d; d = d->next)
+			output_device(&out, d);
+		output_end(&out);
+	}
+}
+
+int main(void)
+{
+	static const char *formats[] = { "text", "short", "json", "csv", "prometheus" };
+	gpu_t devices[DEVICES];
+	format_bench_t fb;
+	unsigned char *image;
+	char name[64];
+	rom_t rom;
+	size_t i;
+
+	report("find_gpu", bench_find_gpu, NULL);
+	report("find_mem", bench_find_mem, NULL);
+	report("subvendor_name", bench_subvendor_name, NULL);
+
+	if ((image = make_rom(&rom)) == NULL)
+		return 1;
+	report("bios_version", bench_bios_version, &rom);
+	free(image);
+
+	if ((fb.fd = open("/dev/null", O_WRONLY)) < 0)
+		return 1;
+
+	make_devices(devices);
+	fb.devices = devices;
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+		output_parse_format(formats[i], &fb.format);
+		snprintf(name, sizeof(name), "output_%s_%d", formats[i], DEVICES);
+		report(name, bench_format, &fb);
+	}
+
+	close(fb.fd);
+
+	return 0;
+}
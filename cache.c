@@ -0,0 +1,177 @@
+/*
+ * AMDGPUInfo - persistent probe cache
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Probe results only change on reboot or hot-plug, so they are kept in
+ * one small file per device under CACHE_DIR. An entry is only used when
+ * the boot id, PCI address, device/subsystem ids and the names the
+ * current tables resolve to all match what was stored.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+#define CACHE_MAGIC "AGICACHE"
+#define CACHE_VERSION 2
+
+#define BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	char boot_id[40];
+	uint16_t vendor_id, device_id;
+	uint32_t subvendor, subdevice;
+	uint8_t pcirev, pad[3];
+	int32_t memconfig, mem_type, mem_manufacturer, mem_model;
+	char bios_version[64];
+	char gpu_name[64];
+	char mem_name[64];
+	uint64_t rom_hash, timing_hash;
+	uint8_t fp_valid, checksum_ok, pad2[6];
+} cache_entry_t;
+
+bool cache_boot_id(char *buf, size_t len)
+{
+	ssize_t n;
+	int fd;
+
+	if ((fd = open(BOOT_ID_PATH, O_RDONLY)) < 0)
+		return false;
+
+	n = read(fd, buf, len - 1);
+	close(fd);
+
+	if (n <= 0)
+		return false;
+
+	buf[n] = 0;
+	buf[strcspn(buf, "\n")] = 0;
+
+	return buf[0] != 0;
+}
+
+static void cache_path(char *buf, size_t len, const char *dir, const gpu_t *gpu)
+{
+	snprintf(buf, len, "%s/%04x:%02x:%02x.%x", dir, gpu->pcidomain, gpu->pcibus, gpu->pcidev, gpu->pcifunc);
+}
+
+static void copy_name(char *dst, const char *src, size_t len)
+{
+	memset(dst, 0, len);
+	if (src != NULL)
+		memcpy(dst, src, strnlen(src, len - 1));
+}
+
+// fill in a device from its cache entry, the ids must already be set
+bool cache_load(const char *dir, const char *boot_id, gpu_t *gpu)
+{
+	char path[1024], name[64];
+	cache_entry_t e;
+	const gputype_t *g;
+	const memtype_t *m;
+	ssize_t n;
+	int fd;
+
+	cache_path(path, sizeof(path), dir, gpu);
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return false;
+
+	n = read(fd, &e, sizeof(e));
+	close(fd);
+
+	if (n != sizeof(e) ||
+	    memcmp(e.magic, CACHE_MAGIC, sizeof(e.magic)) != 0 ||
+	    e.version != CACHE_VERSION ||
+	    strncmp(e.boot_id, boot_id, sizeof(e.boot_id)) != 0 ||
+	    e.vendor_id != gpu->vendor_id || e.device_id != gpu->device_id ||
+	    e.subvendor != gpu->subvendor || e.subdevice != gpu->subdevice ||
+	    e.pcirev != gpu->pcirev)
+		return false;
+
+	// a binary with different tables must not reuse stale names
+	g = find_gpu(gpu->device_id, gpu->subdevice, gpu->pcirev);
+	m = find_mem(e.mem_type, e.mem_manufacturer, e.mem_model);
+
+	copy_name(name, g ? g->name : NULL, sizeof(name));
+	if (g == NULL || strncmp(name, e.gpu_name, sizeof(name)) != 0)
+		return false;
+
+	copy_name(name, m ? m->name : NULL, sizeof(name));
+	if (strncmp(name, e.mem_name, sizeof(name)) != 0)
+		return false;
+
+	gpu->gpu = g;
+	gpu->mem = m;
+	gpu->memconfig = e.memconfig;
+	gpu->mem_type = e.mem_type;
+	gpu->mem_manufacturer = e.mem_manufacturer;
+	gpu->mem_model = e.mem_model;
+	memcpy(gpu->bios_version, e.bios_version, sizeof(gpu->bios_version));
+	gpu->bios_version[sizeof(gpu->bios_version) - 1] = 0;
+	gpu->fp.rom_hash = e.rom_hash;
+	gpu->fp.timing_hash = e.timing_hash;
+	gpu->fp.valid = e.fp_valid;
+	gpu->fp.checksum_ok = e.checksum_ok;
+	gpu->cached = true;
+
+	return true;
+}
+
+// write the entry next to its final name and rename it into place
+bool cache_store(const char *dir, const char *boot_id, const gpu_t *gpu)
+{
+	char path[1024], tmp[1100];
+	cache_entry_t e;
+	bool ok;
+	int fd;
+
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+		return false;
+
+	memset(&e, 0, sizeof(e));
+	memcpy(e.magic, CACHE_MAGIC, sizeof(e.magic));
+	e.version = CACHE_VERSION;
+	copy_name(e.boot_id, boot_id, sizeof(e.boot_id));
+	e.vendor_id = gpu->vendor_id;
+	e.device_id = gpu->device_id;
+	e.subvendor = gpu->subvendor;
+	e.subdevice = gpu->subdevice;
+	e.pcirev = gpu->pcirev;
+	e.memconfig = gpu->memconfig;
+	e.mem_type = gpu->mem_type;
+	e.mem_manufacturer = gpu->mem_manufacturer;
+	e.mem_model = gpu->mem_model;
+	copy_name(e.bios_version, gpu->bios_version, sizeof(e.bios_version));
+	copy_name(e.gpu_name, gpu->gpu ? gpu->gpu->name : NULL, sizeof(e.gpu_name));
+	copy_name(e.mem_name, gpu->mem ? gpu->mem->name : NULL, sizeof(e.mem_name));
+	e.rom_hash = gpu->fp.rom_hash;
+	e.timing_hash = gpu->fp.timing_hash;
+	e.fp_valid = gpu->fp.valid;
+	e.checksum_ok = gpu->fp.checksum_ok;
+
+	cache_path(path, sizeof(path), dir, gpu);
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return false;
+
+	ok = write(fd, &e, sizeof(e)) == sizeof(e);
+	ok = (close(fd) == 0) && ok;
+
+	if (!ok || rename(tmp, path) < 0) {
+		unlink(tmp);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,20 @@
+/*
+ * AMDGPUInfo - persistent probe cache
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+
+#include "gpu.h"
+
+#define CACHE_DIR "/run/amdgpuinfo"
+
+bool cache_boot_id(char *buf, size_t len);
+bool cache_load(const char *dir, const char *boot_id, gpu_t *gpu);
+bool cache_store(const char *dir, const char *boot_id, const gpu_t *gpu);
+
+#endif
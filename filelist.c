@@ -0,0 +1,89 @@
+/*
+ * AMDGPUInfo - input file lists
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <ftw.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "filelist.h"
+
+// nftw() has no user pointer
+static file_list_t *walk_list;
+
+bool file_list_add(file_list_t *list, const char *path)
+{
+	char **files;
+	size_t alloc;
+
+	if (list->count == list->alloc) {
+		alloc = list->alloc ? list->alloc * 2 : 256;
+		if ((files = realloc(list->files, alloc * sizeof(char *))) == NULL)
+			return false;
+		list->files = files;
+		list->alloc = alloc;
+	}
+
+	if ((list->files[list->count] = strdup(path)) == NULL)
+		return false;
+	++list->count;
+
+	return true;
+}
+
+// symlinks to files count, symlinked directories are not followed
+static int walk_file(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+	struct stat target;
+
+	(void)ftw;
+
+	if (type == FTW_SL && stat(path, &target) == 0)
+		st = &target;
+	else if (type != FTW_F)
+		return 0;
+
+	if (S_ISREG(st->st_mode) && !file_list_add(walk_list, path))
+		return 1;
+
+	return 0;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+bool file_list_paths(file_list_t *list, char *const *paths, size_t count)
+{
+	struct stat st;
+	size_t i, first;
+
+	for (i = 0; i < count; ++i)
+	{
+		if (stat(paths[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+			first = list->count;
+			walk_list = list;
+			if (nftw(paths[i], walk_file, 64, FTW_PHYS) != 0)
+				return false;
+			// directory order is arbitrary, hand them out sorted
+			qsort(list->files + first, list->count - first, sizeof(char *), compare_paths);
+		} else if (!file_list_add(list, paths[i])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void file_list_free(file_list_t *list)
+{
+	size_t i;
+
+	for (i = 0; i < list->count; ++i)
+		free(list->files[i]);
+	free(list->files);
+}
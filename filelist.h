@@ -0,0 +1,29 @@
+/*
+ * AMDGPUInfo - input file lists
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FILELIST_H
+#define FILELIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+	char **files;
+	size_t count, alloc;
+} file_list_t;
+
+bool file_list_add(file_list_t *list, const char *path);
+
+/*
+ * Add every path, directories are searched recursively and their
+ * files added in sorted order. Symlinks to files count, symlinked
+ * directories are not followed.
+ */
+bool file_list_paths(file_list_t *list, char *const *paths, size_t count);
+
+void file_list_free(file_list_t *list);
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ * AMDGPUInfo - VBIOS fingerprints
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Mods usually edit the memory timing straps and leave the version
+ * string alone, so an image is fingerprinted twice: as a whole, and
+ * just the VRAM_Info table the straps live in. A catalog of known good
+ * images then tells a timing mod from any other change.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atom.h"
+#include "fingerprint.h"
+
+#define ROM_LEGACY_LENGTH 0x02
+
+#define PRIME64_1 0x9e3779b185ebca87ull
+#define PRIME64_2 0xc2b2ae3d27d4eb4full
+#define PRIME64_3 0x165667b19e3779f9ull
+#define PRIME64_4 0x85ebca77c2b2ae63ull
+#define PRIME64_5 0x27d4eb2f165667c5ull
+
+typedef struct {
+	char version[64];
+	uint64_t rom_hash, timing_hash;
+} catalog_entry_t;
+
+struct fp_catalog {
+	catalog_entry_t *entries;	// sorted by version
+	size_t count;
+};
+
+static const char *status_names[] = {
+	[FP_UNCHECKED] = "unchecked",
+	[FP_OK] = "ok",
+	[FP_UNKNOWN] = "unknown",
+	[FP_MODIFIED] = "modified",
+	[FP_TIMINGS_MODIFIED] = "timings_modified",
+	[FP_CORRUPT] = "corrupt",
+};
+
+/***********************************************
+ * Hash
+ ***********************************************/
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline uint32_t read32(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static inline uint64_t hash_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= hash_round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t fingerprint_hash(const void *data, size_t len, uint64_t seed)
+{
+	const unsigned char *p = data, *end = p + len, *limit;
+	uint64_t v1, v2, v3, v4, h;
+
+	if (len >= 32) {
+		v1 = seed + PRIME64_1 + PRIME64_2;
+		v2 = seed + PRIME64_2;
+		v3 = seed;
+		v4 = seed - PRIME64_1;
+		limit = end - 32;
+
+		// the lanes do not depend on each other
+		do {
+			v1 = hash_round(v1, read64(p));
+			v2 = hash_round(v2, read64(p + 8));
+			v3 = hash_round(v3, read64(p + 16));
+			v4 = hash_round(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = hash_merge(h, v1);
+		h = hash_merge(h, v2);
+		h = hash_merge(h, v3);
+		h = hash_merge(h, v4);
+	} else {
+		h = seed + PRIME64_5;
+	}
+
+	h += (uint64_t)len;
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= hash_round(0, read64(p));
+		h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+
+	if (p + 4 <= end) {
+		h ^= (uint64_t)read32(p) * PRIME64_1;
+		h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+
+	for (; p < end; ++p) {
+		h ^= (uint64_t)*p * PRIME64_5;
+		h = rotl64(h, 11) * PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+/***********************************************
+ * Images
+ ***********************************************/
+
+// the legacy image, ROM[2] 512 byte blocks, has to sum to zero
+static bool checksum_ok(const rom_t *rom)
+{
+	size_t i, len;
+	uint8_t blocks, sum = 0;
+
+	if (!rom_u8(rom, ROM_LEGACY_LENGTH, &blocks) || blocks == 0)
+		return false;
+
+	len = (size_t)blocks * 512;
+	if (len > rom->size)
+		return false;
+
+	for (i = 0; i < len; ++i)
+		sum += rom->data[i];
+
+	return sum == 0;
+}
+
+bool fingerprint_rom(fingerprint_t *fp, const rom_t *rom)
+{
+	const atom_table_t *vram;
+	atom_t atom;
+
+	memset(fp, 0, sizeof(*fp));
+
+	if (rom == NULL || rom->data == NULL || rom->size == 0)
+		return false;
+
+	fp->rom_hash = fingerprint_hash(rom->data, rom->size, 0);
+	fp->checksum_ok = checksum_ok(rom);
+
+	// no VRAM_Info leaves the timing hash at 0
+	if (atom_init(&atom, rom) &&
+	    (vram = atom_data_table(&atom, ATOM_DATA_VRAM_INFO)) != NULL &&
+	    vram->offset != 0 && (size_t)vram->offset + vram->size <= rom->size)
+		fp->timing_hash = fingerprint_hash(rom->data + vram->offset, vram->size, 0);
+
+	fp->valid = true;
+
+	return true;
+}
+
+const char *fingerprint_status_name(int status)
+{
+	if (status < 0 || (size_t)status >= sizeof(status_names) / sizeof(status_names[0]))
+		return "unchecked";
+
+	return status_names[status];
+}
+
+/***********************************************
+ * Catalog
+ ***********************************************/
+static int compare_entries(const void *a, const void *b)
+{
+	return strcmp(((const catalog_entry_t *)a)->version, ((const catalog_entry_t *)b)->version);
+}
+
+fp_catalog_t *fingerprint_catalog_load(const char *path)
+{
+	char line[256], version[64];
+	catalog_entry_t *entries;
+	fp_catalog_t *catalog;
+	uint64_t rom_hash, timing_hash;
+	size_t alloc = 0;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL)
+		return NULL;
+
+	if ((catalog = (fp_catalog_t *)calloc(1, sizeof(fp_catalog_t))) == NULL) {
+		fclose(f);
+		return NULL;
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == 0)
+			continue;
+
+		if (sscanf(line, "%63s %" SCNx64 " %" SCNx64, version, &rom_hash, &timing_hash) != 3) {
+			fingerprint_catalog_free(catalog);
+			fclose(f);
+			errno = EINVAL;
+			return NULL;
+		}
+
+		if (catalog->count == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			if ((entries = (catalog_entry_t *)realloc(catalog->entries, alloc * sizeof(catalog_entry_t))) == NULL) {
+				fingerprint_catalog_free(catalog);
+				fclose(f);
+				return NULL;
+			}
+			catalog->entries = entries;
+		}
+
+		memcpy(catalog->entries[catalog->count].version, version, sizeof(version));
+		catalog->entries[catalog->count].rom_hash = rom_hash;
+		catalog->entries[catalog->count].timing_hash = timing_hash;
+		++catalog->count;
+	}
+
+	fclose(f);
+
+	if (catalog->count > 0)
+		qsort(catalog->entries, catalog->count, sizeof(catalog_entry_t), compare_entries);
+
+	return catalog;
+}
+
+void fingerprint_catalog_free(fp_catalog_t *catalog)
+{
+	if (catalog == NULL)
+		return;
+
+	free(catalog->entries);
+	free(catalog);
+}
+
+int fingerprint_check(const fp_catalog_t *catalog, const char *bios_version, const fingerprint_t *fp)
+{
+	const catalog_entry_t *e, *end;
+	catalog_entry_t key;
+	bool known = false, stock_timings = false;
+
+	if (fp == NULL || !fp->valid)
+		return FP_UNCHECKED;
+
+	// needs no catalog
+	if (!fp->checksum_ok)
+		return FP_CORRUPT;
+
+	if (catalog == NULL || catalog->count == 0)
+		return FP_UNCHECKED;
+
+	memset(&key, 0, sizeof(key));
+	snprintf(key.version, sizeof(key.version), "%s", bios_version);
+
+	if ((e = bsearch(&key, catalog->entries, catalog->count, sizeof(catalog_entry_t), compare_entries)) == NULL)
+		return FP_UNKNOWN;
+
+	// a version can have several good images, check them all
+	while (e > catalog->entries && !strcmp(e[-1].version, key.version))
+		--e;
+
+	for (end = catalog->entries + catalog->count; e < end && !strcmp(e->version, key.version); ++e) {
+		if (e->rom_hash == fp->rom_hash)
+			return FP_OK;
+		if (e->timing_hash == fp->timing_hash)
+			stock_timings = true;
+		known = true;
+	}
+
+	if (!known)
+		return FP_UNKNOWN;
+
+	return stock_timings ? FP_MODIFIED : FP_TIMINGS_MODIFIED;
+}
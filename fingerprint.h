@@ -0,0 +1,50 @@
+/*
+ * AMDGPUInfo - VBIOS fingerprints
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rom.h"
+
+typedef struct {
+	uint64_t rom_hash;	// the whole image
+	uint64_t timing_hash;	// VRAM_Info: memory modules and their timing straps
+	bool valid;		// computed from an image
+	bool checksum_ok;	// legacy image bytes sum to zero
+} fingerprint_t;
+
+// what a fingerprint says about the image, see fingerprint_check()
+enum {
+	FP_UNCHECKED = 0,	// no image, or no catalog to check against
+	FP_OK,			// matches a known good image
+	FP_UNKNOWN,		// version not in the catalog
+	FP_MODIFIED,		// known version, same memory timings, other bytes differ
+	FP_TIMINGS_MODIFIED,	// known version with different memory timings
+	FP_CORRUPT,		// bad checksum
+};
+
+typedef struct fp_catalog fp_catalog_t;
+
+// XXH64, four independent lanes so the main loop pipelines well
+uint64_t fingerprint_hash(const void *data, size_t len, uint64_t seed);
+
+bool fingerprint_rom(fingerprint_t *fp, const rom_t *rom);
+const char *fingerprint_status_name(int status);
+
+/*
+ * Known good images, one per line: the BIOS version, then rom_hash and
+ * timing_hash in hex. Blank lines and lines starting with # are skipped.
+ */
+fp_catalog_t *fingerprint_catalog_load(const char *path);
+void fingerprint_catalog_free(fp_catalog_t *catalog);
+
+int fingerprint_check(const fp_catalog_t *catalog, const char *bios_version, const fingerprint_t *fp);
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * AMDGPUInfo - per-device probe results
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef GPU_H
+#define GPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pci/pci.h>
+
+#include "fingerprint.h"
+#include "gpudb.h"
+#include "rom.h"
+#include "timing.h"
+
+#define AMD_PCI_VENDOR_ID 0x1002
+
+typedef struct gpu {
+	u16 vendor_id, device_id;
+	const gputype_t *gpu;
+	const memtype_t *mem;
+	int memconfig, mem_type, mem_manufacturer, mem_model;
+	int pcidomain;
+	u8 pcibus, pcidev, pcifunc, pcirev;
+	u32 subvendor, subdevice;
+	pciaddr_t base_addr[6], size[6];
+	bool mmio_failed;
+	bool cached; // results came from the probe cache
+	bool timed_out; // the probe missed its deadline, results are partial
+	char *path;
+	char *subsystem; // subsystem vendor name, only looked up for the formats showing it
+	const rom_t *vbios; // only valid while the device is being probed
+	char bios_version[64];
+	fingerprint_t fp; // of the VBIOS image
+	int rom_status; // FP_*, the fingerprint checked against the catalog
+	uint64_t time[TIME_DEVICE_PHASES]; // ns per probe phase, for --timings
+	struct gpu *prev, *next;
+} gpu_t;
+
+#endif
@@ -0,0 +1,395 @@
+/*
+ * AMDGPUInfo - GPU and memory type database
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gpudb.h"
+
+static const char *mem_type_label[] = {
+	"Unknown",
+	"DDR1",
+	"DDR2",
+	"DDR3",
+	"DDR4",
+	"GDDR5",
+	"HBM",
+	"GDDR6",
+};
+
+static const char *amd_asic_name[] = {
+	"Unknown",
+	"Cypress",
+	"Hemlock",
+	"Caicos",
+	"Barts",
+	"Cayman",
+	"Antilles",
+	"Tahiti",
+	"Pitcairn",
+	"Verde",
+	"Oland",
+	"Hainan",
+	"Bonaire",
+	"Kaveri",
+	"Kabini",
+	"Hawaii",
+	"Mullins",
+	"Topaz",
+	"Tonga",
+	"Fiji",
+	"Carrizo",
+	"Stoney",
+	"Polaris10",
+	"Polaris11",
+	"Polaris12",
+	"Polaris20",
+	"Polaris30",
+	"Vega10",
+	"Vega20",
+	"Navi10",
+	"Navi12",
+	"Navi14",
+	"Raven",
+};
+
+// manufacturer nibble of the MC scratch register, also used by the ATOM tables
+static const char *mem_vendor_label[16] = {
+	[0x0] = "Unknown",
+	[0x1] = "Samsung",
+	[0x2] = "Infineon",
+	[0x3] = "Elpida",
+	[0x4] = "Etron",
+	[0x5] = "Nanya",
+	[0x6] = "SK Hynix",
+	[0x7] = "Mosel",
+	[0x8] = "Winbond",
+	[0x9] = "ESMT",
+	[0xf] = "Micron",
+};
+
+const char *asic_name(unsigned int asic_type)
+{
+	if (asic_type >= sizeof(amd_asic_name) / sizeof(amd_asic_name[0]))
+		asic_type = CHIP_UNKNOWN;
+
+	return amd_asic_name[asic_type];
+}
+
+const char *mem_type_name(int mem_type)
+{
+	if (mem_type < 0 || (size_t)mem_type >= sizeof(mem_type_label) / sizeof(mem_type_label[0]))
+		mem_type = MEM_UNKNOWN;
+
+	return mem_type_label[mem_type];
+}
+
+const char *mem_vendor_name(int manufacturer)
+{
+	if (manufacturer < 0 || manufacturer > 15 || mem_vendor_label[manufacturer] == NULL)
+		manufacturer = 0;
+
+	return mem_vendor_label[manufacturer];
+}
+
+/*
+ * The tables themselves live in data/ and are turned into C by
+ * tools/gen-gpudb.py at build time, together with their indexes.
+ */
+
+// must match gpu_key() and gpu_hash() in tools/gen-gpudb.py
+#define GPUDB_HASH(key, bits) ((unsigned int)(((key) * 0x9e3779b97f4a7c15ULL) >> (64 - (bits))))
+
+static inline uint64_t gpu_key(unsigned int device_id, unsigned long subsys_id, unsigned char rev_id)
+{
+	return ((uint64_t)subsys_id << 24) | ((uint64_t)rev_id << 16) | (device_id & 0xffff);
+}
+
+/***********************************************
+ * Runtime database
+ ***********************************************/
+
+/*
+ * Optional replacement for the built-in tables, written by
+ * tools/mkgpudb.py. The file is mapped read-only and validated once,
+ * then bsearch()ed through gputype_t/memtype_t views of its sorted
+ * records, whose names point straight into the map.
+ */
+#define GPUDB_MAGIC "AGIGPUDB"
+#define GPUDB_VERSION 1
+#define GPUDB_HEADER_SIZE 40
+#define GPUDB_GPU_SIZE 16
+#define GPUDB_MEM_SIZE 8
+
+static struct {
+	const unsigned char *map;
+	size_t size;
+	gputype_t *gpus;
+	memtype_t *mems;
+	size_t gpu_count, mem_count;
+} db;
+
+static uint32_t le16(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t le32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// an offset/count pair must describe records inside the file
+static bool db_range(size_t size, uint32_t offset, uint32_t count, size_t rec_size)
+{
+	return offset <= size && count <= (size - offset) / rec_size;
+}
+
+static int db_compare_gpu(const void *key, const void *rec)
+{
+	const gputype_t *a = key, *b = rec;
+	uint64_t x = gpu_key(a->device_id, a->subsys_id, a->rev_id);
+	uint64_t y = gpu_key(b->device_id, b->subsys_id, b->rev_id);
+
+	return (x > y) - (x < y);
+}
+
+static int db_compare_mem(const void *key, const void *rec)
+{
+	const memtype_t *a = key, *b = rec;
+
+	if (a->type != b->type)
+		return a->type - b->type;
+	if (a->manufacturer != b->manufacturer)
+		return a->manufacturer - b->manufacturer;
+	return a->model - b->model;
+}
+
+bool gpudb_load(const char *path)
+{
+	uint32_t gpu_count, gpu_offset, mem_count, mem_offset, str_offset, str_size, name;
+	const unsigned char *p, *strings, *gpu_recs, *mem_recs;
+	struct stat st;
+	void *map;
+	size_t i;
+	int fd;
+
+	gpudb_unload();
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return false;
+
+	if (fstat(fd, &st) < 0 || st.st_size < GPUDB_HEADER_SIZE ||
+	    (map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+	close(fd);
+
+	db.map = map;
+	db.size = (size_t)st.st_size;
+	p = db.map;
+
+	gpu_count = le32(p + 12);
+	gpu_offset = le32(p + 16);
+	mem_count = le32(p + 20);
+	mem_offset = le32(p + 24);
+	str_offset = le32(p + 28);
+	str_size = le32(p + 32);
+
+	if (memcmp(p, GPUDB_MAGIC, 8) != 0 || le32(p + 8) != GPUDB_VERSION ||
+	    !db_range(db.size, gpu_offset, gpu_count, GPUDB_GPU_SIZE) ||
+	    !db_range(db.size, mem_offset, mem_count, GPUDB_MEM_SIZE) ||
+	    !db_range(db.size, str_offset, str_size, 1) ||
+	    str_size == 0 || p[str_offset + str_size - 1] != 0)
+		goto invalid;
+
+	// the last string is terminated, so any offset in range is a valid name
+	strings = p + str_offset;
+	gpu_recs = p + gpu_offset;
+	mem_recs = p + mem_offset;
+	db.gpu_count = gpu_count;
+	db.mem_count = mem_count;
+
+	if ((db.gpus = calloc(gpu_count ? gpu_count : 1, sizeof(gputype_t))) == NULL ||
+	    (db.mems = calloc(mem_count ? mem_count : 1, sizeof(memtype_t))) == NULL)
+		goto invalid;
+
+	for (i = 0; i < gpu_count; ++i)
+	{
+		p = gpu_recs + i * GPUDB_GPU_SIZE;
+		if ((name = le32(p + 8)) >= str_size)
+			goto invalid;
+		db.gpus[i].subsys_id = le32(p);
+		db.gpus[i].device_id = le16(p + 4);
+		db.gpus[i].rev_id = p[6];
+		db.gpus[i].asic_type = p[7];
+		db.gpus[i].name = (const char *)strings + name;
+
+		// bsearch() needs strictly ascending keys
+		if (i > 0 && db_compare_gpu(&db.gpus[i], &db.gpus[i - 1]) <= 0)
+			goto invalid;
+	}
+
+	for (i = 0; i < mem_count; ++i)
+	{
+		p = mem_recs + i * GPUDB_MEM_SIZE;
+		if ((name = le32(p + 4)) >= str_size || p[1] > 16 || p[2] > 16)
+			goto invalid;
+		db.mems[i].type = p[0];
+		db.mems[i].manufacturer = (int)p[1] - 1;
+		db.mems[i].model = (int)p[2] - 1;
+		db.mems[i].name = (const char *)strings + name;
+
+		if (i > 0 && db_compare_mem(&db.mems[i], &db.mems[i - 1]) <= 0)
+			goto invalid;
+	}
+
+	return true;
+
+invalid:
+	gpudb_unload();
+	return false;
+}
+
+void gpudb_unload(void)
+{
+	if (db.map != NULL)
+		munmap((void *)db.map, db.size);
+
+	free(db.gpus);
+	free(db.mems);
+	memset(&db, 0, sizeof(db));
+}
+
+bool gpudb_loaded(void)
+{
+	return db.map != NULL;
+}
+
+/***********************************************
+ * Lookups
+ ***********************************************/
+
+// find GPU type by exact device id/subsys id/rev id
+static const gputype_t *_find_gpu(unsigned int device_id, unsigned long subsys_id, unsigned char rev_id)
+{
+	uint64_t key = gpu_key(device_id, subsys_id, rev_id);
+	unsigned int mask = (1u << gputype_index_bits) - 1;
+	unsigned int i = GPUDB_HASH(key, gputype_index_bits);
+	const gputype_t *g;
+
+	// the views are in the same order as the sorted records
+	if (db.map != NULL) {
+		gputype_t want = { device_id, subsys_id, rev_id, NULL, 0 };
+		return bsearch(&want, db.gpus, db.gpu_count, sizeof(gputype_t), db_compare_gpu);
+	}
+
+	// the index is at most half full, so this always hits an empty slot
+	while (gputype_index[i])
+	{
+		g = &gputypes[gputype_index[i] - 1];
+		if (gpu_key(g->device_id, g->subsys_id, g->rev_id) == key) {
+			return g;
+		}
+		i = (i + 1) & mask;
+	}
+
+	return NULL;
+}
+
+// find GPU type by vendor id/device id
+const gputype_t *find_gpu(unsigned int device_id, unsigned long subsys_id, unsigned char rev_id)
+{
+	const gputype_t *g = _find_gpu(device_id, subsys_id, rev_id);
+
+	//if specific subsys id not found, try again with 0
+	if (g == NULL && subsys_id > 0) {
+		g = _find_gpu(device_id, 0, rev_id);
+	}
+
+	//if specific rev id not found, try again with 0 for general device type
+	if (g == NULL && rev_id > 0) {
+		g = _find_gpu(device_id, subsys_id, 0);
+	}
+
+	//if still not found, try no rev id or subsys id
+	if (g == NULL) {
+		g = _find_gpu(device_id, 0, 0);
+	}
+
+	return g;
+}
+
+// Find Memory Model by manufacturer/model
+const memtype_t *find_mem(int mem_type, int manufacturer, int model)
+{
+	memtype_t want = { mem_type, manufacturer, model, NULL };
+	const memtype_t *found;
+	unsigned char m;
+
+	if (mem_type < 0 || mem_type > 15 || manufacturer < -1 || manufacturer > 15)
+		return NULL;
+
+	if (db.map != NULL) {
+		if ((found = bsearch(&want, db.mems, db.mem_count, sizeof(memtype_t), db_compare_mem)) != NULL)
+			return found;
+		return (model > -1) ? find_mem(mem_type, manufacturer, -1) : NULL;
+	}
+
+	if (model >= -1 && model <= 15 &&
+	    (m = memtype_index[mem_type][manufacturer + 1][model + 1]) != 0) {
+		return &memtypes[m - 1];
+	}
+
+	if (model > -1) {
+		return find_mem(mem_type, manufacturer, -1);
+	}
+
+	return NULL;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+	return (int)*(const unsigned short *)a - (int)*(const unsigned short *)b;
+}
+
+/*
+ * Check if a device is an APU
+ *
+ * The table holds every AMD display device id whose pci.ids name marks it
+ * as one of the integrated GPU families, so no name database is needed.
+ */
+bool is_apu(unsigned int device_id)
+{
+	unsigned short id = (unsigned short)device_id;
+
+	return bsearch(&id, apu_ids, apu_ids_count, sizeof(apu_ids[0]), compare_ids) != NULL;
+}
+
+static int compare_subvendors(const void *a, const void *b)
+{
+	return (int)((const subvendor_t *)a)->vendor_id - (int)((const subvendor_t *)b)->vendor_id;
+}
+
+/*
+ * Name of a board vendor, from the few hundred bytes of pci.ids that
+ * name the vendors of AMD boards, instead of parsing all of it.
+ */
+const char *subvendor_name(unsigned int vendor_id)
+{
+	subvendor_t key = { (unsigned short)vendor_id, NULL };
+	const subvendor_t *v;
+
+	v = bsearch(&key, subvendors, subvendors_count, sizeof(subvendors[0]), compare_subvendors);
+
+	return v ? v->name : NULL;
+}
@@ -0,0 +1,113 @@
+/*
+ * AMDGPUInfo - GPU and memory type database
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef GPUDB_H
+#define GPUDB_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define MEM_UNKNOWN 0x0
+#define MEM_GDDR5 0x5
+#define MEM_HBM  0x6
+#define MEM_GDDR6 0x7
+
+typedef enum AMD_CHIPS {
+	CHIP_UNKNOWN = 0,
+	CHIP_CYPRESS,
+	CHIP_HEMLOCK,
+	CHIP_CAICOS,
+	CHIP_BARTS,
+	CHIP_CAYMAN,
+	CHIP_ANTILLES,
+	CHIP_TAHITI,
+	CHIP_PITCAIRN,
+	CHIP_VERDE,
+	CHIP_OLAND,
+	CHIP_HAINAN,
+	CHIP_BONAIRE,
+	CHIP_KAVERI,
+	CHIP_KABINI,
+	CHIP_HAWAII,
+	CHIP_MULLINS,
+	CHIP_TOPAZ,
+	CHIP_TONGA,
+	CHIP_FIJI,
+	CHIP_CARRIZO,
+	CHIP_STONEY,
+	CHIP_POLARIS10,
+	CHIP_POLARIS11,
+	CHIP_POLARIS12,
+	CHIP_POLARIS20,
+	CHIP_POLARIS30,
+	CHIP_VEGA10,
+	CHIP_VEGA20,
+	CHIP_NAVI10,
+	CHIP_NAVI12,
+	CHIP_NAVI14,
+	CHIP_RAVEN,
+} asic_type_t;
+
+/***********************************************
+ * GPU Types
+ ***********************************************/
+typedef struct {
+	unsigned int device_id;
+	unsigned long subsys_id;
+	unsigned char rev_id;
+	const char *name;
+	unsigned int asic_type;
+} gputype_t;
+
+/*************************************************
+ * Memory Models
+ *************************************************/
+typedef struct {
+	int type;
+	int manufacturer;
+	int model;
+	const char *name;
+} memtype_t;
+
+typedef struct {
+	unsigned short vendor_id;
+	const char *name;
+} subvendor_t;
+
+const gputype_t *find_gpu(unsigned int device_id, unsigned long subsys_id, unsigned char rev_id);
+const memtype_t *find_mem(int mem_type, int manufacturer, int model);
+bool is_apu(unsigned int device_id);
+const char *subvendor_name(unsigned int vendor_id); // NULL if not in the table
+
+const char *asic_name(unsigned int asic_type);
+const char *mem_type_name(int mem_type);
+const char *mem_vendor_name(int manufacturer);
+
+// replace the built-in tables with a file written by tools/mkgpudb.py
+bool gpudb_load(const char *path);
+void gpudb_unload(void);
+bool gpudb_loaded(void);
+
+/*
+ * Generated from data/gputypes.txt, data/memtypes.txt, data/apus.txt and
+ * data/subvendors.txt by tools/gen-gpudb.py, only meant to be used by gpudb.c.
+ */
+extern const gputype_t gputypes[];
+extern const size_t gputypes_count;
+extern const unsigned int gputype_index_bits;
+extern const unsigned short gputype_index[];
+
+extern const memtype_t memtypes[];
+extern const size_t memtypes_count;
+extern const unsigned char memtype_index[16][17][17];
+
+extern const unsigned short apu_ids[];
+extern const size_t apu_ids_count;
+
+extern const subvendor_t subvendors[];
+extern const size_t subvendors_count;
+
+#endif
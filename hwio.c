@@ -0,0 +1,673 @@
+/*
+ * AMDGPUInfo - hardware access backends
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hwio.h"
+
+typedef enum {
+	HWIO_REAL,
+	HWIO_RECORD,
+	HWIO_REPLAY,
+} hwio_mode_t;
+
+// everything the trace says about one path, or one register
+typedef struct entry {
+	char *key;
+	unsigned char *data;
+	size_t size, alloc;
+	off_t stat_size;
+	bool readable, has_stat, writable, listable, has_value;
+	uint32_t value;
+	char **names;
+	size_t nnames;
+} entry_t;
+
+struct hwio {
+	hwio_mode_t mode;
+	FILE *trace;		// recording
+	pthread_mutex_t lock;	// recording
+	entry_t *entries;	// replay, open addressing
+	size_t nentries, mask;
+	unsigned int latency_us; // replay
+};
+
+static hwio_t real_hwio = { .mode = HWIO_REAL };
+
+/***********************************************
+ * Real hardware
+ ***********************************************/
+static ssize_t real_read(const char *path, void *buf, size_t len, off_t offset)
+{
+	size_t done = 0;
+	ssize_t n;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return -1;
+
+	while (done < len)
+	{
+		n = pread(fd, (char *)buf + done, len - done, offset + (off_t)done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			close(fd);
+			return done ? (ssize_t)done : -1;
+		}
+		if (n == 0)
+			break;
+		done += (size_t)n;
+	}
+
+	close(fd);
+
+	return (ssize_t)done;
+}
+
+static off_t real_size(const char *path)
+{
+	struct stat st;
+
+	return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+static bool real_write(const char *path, const void *data, size_t len)
+{
+	bool ok;
+	int fd;
+
+	if ((fd = open(path, O_WRONLY)) < 0)
+		return false;
+
+	ok = write(fd, data, len) == (ssize_t)len;
+	close(fd);
+
+	return ok;
+}
+
+static char **real_listdir(const char *path, size_t *count)
+{
+	char **list = NULL, **grown;
+	size_t alloc = 0;
+	struct dirent *e;
+	DIR *dir;
+
+	*count = 0;
+
+	if ((dir = opendir(path)) == NULL)
+		return NULL;
+
+	while ((e = readdir(dir)) != NULL)
+	{
+		if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+			continue;
+
+		if (*count == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			if ((grown = realloc(list, alloc * sizeof(char *))) == NULL)
+				break;
+			list = grown;
+		}
+
+		if ((list[*count] = strdup(e->d_name)) == NULL)
+			break;
+		++*count;
+	}
+
+	closedir(dir);
+
+	// an empty directory still lists fine
+	if (list == NULL)
+		list = calloc(1, sizeof(char *));
+
+	return list;
+}
+
+static bool real_mmio_read(const char *source, off_t base, size_t size,
+			   const unsigned int *regs, uint32_t *vals, size_t n)
+{
+	size_t page = (size_t)sysconf(_SC_PAGESIZE), lo = SIZE_MAX, hi = 0, start, len, i;
+	volatile uint32_t *mmio;
+	void *map;
+	int fd;
+
+	// only the pages holding the registers get mapped
+	for (i = 0; i < n; ++i)
+	{
+		if ((size_t)regs[i] >= size / 4)
+			return false;
+		if ((size_t)regs[i] * 4 < lo)
+			lo = (size_t)regs[i] * 4;
+		if ((size_t)regs[i] * 4 + 4 > hi)
+			hi = (size_t)regs[i] * 4 + 4;
+	}
+
+	if (n == 0)
+		return true;
+
+	start = lo & ~(page - 1);
+	len = (hi - start + page - 1) & ~(page - 1);
+
+	if ((fd = open(source, O_RDONLY)) < 0)
+		return false;
+
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, base + (off_t)start);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return false;
+
+	mmio = (volatile uint32_t *)map;
+	for (i = 0; i < n; ++i)
+		vals[i] = mmio[(regs[i] * 4 - start) / 4];
+
+	munmap(map, len);
+
+	return true;
+}
+
+/***********************************************
+ * Trace encoding
+ ***********************************************/
+static void put_path(FILE *f, const char *path)
+{
+	for (; *path; ++path)
+	{
+		if (*path == '%' || *path == ' ' || *path == '\n')
+			fprintf(f, "%%%02x", (unsigned char)*path);
+		else
+			fputc(*path, f);
+	}
+}
+
+// decode a %-escaped word in place
+static char *get_path(char *word)
+{
+	char *r = word, *w = word;
+	unsigned int c;
+
+	while (*r)
+	{
+		if (r[0] == '%' && sscanf(r + 1, "%2x", &c) == 1) {
+			*w++ = (char)c;
+			r += 3;
+		} else {
+			*w++ = *r++;
+		}
+	}
+	*w = 0;
+
+	return word;
+}
+
+static void put_hex(FILE *f, const void *data, size_t len)
+{
+	static const char digits[] = "0123456789abcdef";
+	const unsigned char *p = data;
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+	{
+		fputc(digits[p[i] >> 4], f);
+		fputc(digits[p[i] & 0xf], f);
+	}
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/***********************************************
+ * Replay index
+ ***********************************************/
+static size_t hash_key(const char *key)
+{
+	size_t h = 14695981039346656037ULL;
+
+	while (*key)
+		h = (h ^ (unsigned char)*key++) * 1099511628211ULL;
+
+	return h;
+}
+
+static bool index_grow(hwio_t *hw);
+
+static entry_t *index_get(hwio_t *hw, const char *key, bool create)
+{
+	size_t i;
+
+	if (hw->entries == NULL || (create && (hw->nentries + 1) * 2 > hw->mask + 1)) {
+		if (!create || !index_grow(hw))
+			return NULL;
+	}
+
+	for (i = hash_key(key) & hw->mask; hw->entries[i].key; i = (i + 1) & hw->mask)
+	{
+		if (!strcmp(hw->entries[i].key, key))
+			return &hw->entries[i];
+	}
+
+	if (!create || (hw->entries[i].key = strdup(key)) == NULL)
+		return NULL;
+
+	++hw->nentries;
+
+	return &hw->entries[i];
+}
+
+static bool index_grow(hwio_t *hw)
+{
+	size_t size = hw->entries ? (hw->mask + 1) * 2 : 256, i, j;
+	entry_t *entries;
+
+	if ((entries = calloc(size, sizeof(entry_t))) == NULL)
+		return false;
+
+	for (i = 0; hw->entries && i <= hw->mask; ++i)
+	{
+		if (!hw->entries[i].key)
+			continue;
+
+		for (j = hash_key(hw->entries[i].key) & (size - 1); entries[j].key; j = (j + 1) & (size - 1))
+			;
+		entries[j] = hw->entries[i];
+	}
+
+	free(hw->entries);
+	hw->entries = entries;
+	hw->mask = size - 1;
+
+	return true;
+}
+
+static void mmio_key(char *buf, size_t len, const char *source, off_t base, unsigned int reg)
+{
+	snprintf(buf, len, "%s@%llx:%x", source, (unsigned long long)base, reg);
+}
+
+// store hex bytes at offset into the entry's sparse file image
+static bool replay_data(entry_t *e, unsigned long long offset, const char *hex)
+{
+	size_t len = strlen(hex) / 2, i, alloc;
+	unsigned char *data;
+	int hi, lo;
+
+	if (offset + len > e->alloc) {
+		alloc = e->alloc ? e->alloc : 64;
+		while (alloc < offset + len)
+			alloc *= 2;
+		if ((data = realloc(e->data, alloc)) == NULL)
+			return false;
+		memset(data + e->alloc, 0, alloc - e->alloc);
+		e->data = data;
+		e->alloc = alloc;
+	}
+
+	for (i = 0; i < len; ++i)
+	{
+		if ((hi = hex_digit(hex[2 * i])) < 0 || (lo = hex_digit(hex[2 * i + 1])) < 0)
+			return false;
+		e->data[offset + i] = (unsigned char)(hi << 4 | lo);
+	}
+
+	if (offset + len > e->size)
+		e->size = offset + len;
+	e->readable = true;
+
+	return true;
+}
+
+static void replay_wait(const hwio_t *hw)
+{
+	struct timespec ts;
+
+	if (hw->latency_us == 0)
+		return;
+
+	ts.tv_sec = hw->latency_us / 1000000;
+	ts.tv_nsec = (long)(hw->latency_us % 1000000) * 1000;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+static bool replay_line(hwio_t *hw, char *line)
+{
+	char *save = NULL, *op, *path, *word, key[1100];
+	unsigned long long a;
+	unsigned int reg, val;
+	char **names;
+	entry_t *e;
+
+	if ((op = strtok_r(line, " \n", &save)) == NULL || op[0] == '#')
+		return true;
+
+	if ((path = strtok_r(NULL, " \n", &save)) == NULL)
+		return false;
+	get_path(path);
+
+	switch (op[0]) {
+	case 'R':
+		if ((word = strtok_r(NULL, " \n", &save)) == NULL || sscanf(word, "%llx", &a) != 1 ||
+		    (e = index_get(hw, path, true)) == NULL)
+			return false;
+		word = strtok_r(NULL, " \n", &save);
+		return replay_data(e, a, word ? word : "");
+	case 'S':
+		if ((word = strtok_r(NULL, " \n", &save)) == NULL || sscanf(word, "%llx", &a) != 1 ||
+		    (e = index_get(hw, path, true)) == NULL)
+			return false;
+		e->stat_size = (off_t)a;
+		e->has_stat = true;
+		return true;
+	case 'W':
+		if ((e = index_get(hw, path, true)) == NULL)
+			return false;
+		e->writable = true;
+		return true;
+	case 'D':
+		if ((e = index_get(hw, path, true)) == NULL)
+			return false;
+		e->listable = true;
+		while ((word = strtok_r(NULL, " \n", &save)) != NULL)
+		{
+			if ((names = realloc(e->names, (e->nnames + 1) * sizeof(char *))) == NULL)
+				return false;
+			e->names = names;
+			if ((e->names[e->nnames] = strdup(get_path(word))) == NULL)
+				return false;
+			++e->nnames;
+		}
+		return true;
+	case 'M':
+		if ((word = strtok_r(NULL, " \n", &save)) == NULL || sscanf(word, "%llx", &a) != 1 ||
+		    (word = strtok_r(NULL, " \n", &save)) == NULL || sscanf(word, "%x", &reg) != 1 ||
+		    (word = strtok_r(NULL, " \n", &save)) == NULL || sscanf(word, "%x", &val) != 1)
+			return false;
+		mmio_key(key, sizeof(key), path, (off_t)a, reg);
+		if ((e = index_get(hw, key, true)) == NULL)
+			return false;
+		e->value = val;
+		e->has_value = true;
+		return true;
+	}
+
+	return false;
+}
+
+/***********************************************
+ * Backends
+ ***********************************************/
+hwio_t *hwio_real(void)
+{
+	return &real_hwio;
+}
+
+hwio_t *hwio_record(const char *trace)
+{
+	hwio_t *hw;
+
+	if ((hw = calloc(1, sizeof(hwio_t))) == NULL)
+		return NULL;
+
+	if ((hw->trace = fopen(trace, "w")) == NULL) {
+		free(hw);
+		return NULL;
+	}
+
+	hw->mode = HWIO_RECORD;
+	pthread_mutex_init(&hw->lock, NULL);
+	fprintf(hw->trace, "# amdgpuinfo trace v1\n");
+
+	return hw;
+}
+
+hwio_t *hwio_replay(const char *trace)
+{
+	char *line = NULL;
+	size_t alloc = 0;
+	hwio_t *hw;
+	FILE *f;
+
+	if ((f = fopen(trace, "r")) == NULL)
+		return NULL;
+
+	if ((hw = calloc(1, sizeof(hwio_t))) == NULL) {
+		fclose(f);
+		return NULL;
+	}
+
+	hw->mode = HWIO_REPLAY;
+
+	while (getline(&line, &alloc, f) > 0)
+	{
+		if (!replay_line(hw, line)) {
+			hwio_close(hw);
+			hw = NULL;
+			break;
+		}
+	}
+
+	free(line);
+	fclose(f);
+
+	return hw;
+}
+
+void hwio_close(hwio_t *hw)
+{
+	size_t i;
+
+	if (hw == NULL || hw == &real_hwio)
+		return;
+
+	if (hw->trace) {
+		fclose(hw->trace);
+		pthread_mutex_destroy(&hw->lock);
+	}
+
+	for (i = 0; hw->entries && i <= hw->mask; ++i)
+	{
+		free(hw->entries[i].key);
+		free(hw->entries[i].data);
+		hwio_free_list(hw->entries[i].names, hw->entries[i].nnames);
+	}
+
+	free(hw->entries);
+	free(hw);
+}
+
+bool hwio_is_replay(const hwio_t *hw)
+{
+	return hw->mode == HWIO_REPLAY;
+}
+
+void hwio_replay_latency(hwio_t *hw, unsigned int usec)
+{
+	if (hw->mode == HWIO_REPLAY)
+		hw->latency_us = usec;
+}
+
+/***********************************************
+ * Operations
+ ***********************************************/
+ssize_t hwio_read(hwio_t *hw, const char *path, void *buf, size_t len, off_t offset)
+{
+	entry_t *e;
+	ssize_t n;
+
+	if (hw->mode == HWIO_REPLAY) {
+		if ((e = index_get(hw, path, false)) == NULL || !e->readable)
+			return -1;
+		replay_wait(hw);
+		if ((size_t)offset >= e->size)
+			return 0;
+		n = (ssize_t)((e->size - (size_t)offset < len) ? e->size - (size_t)offset : len);
+		memcpy(buf, e->data + offset, (size_t)n);
+		return n;
+	}
+
+	n = real_read(path, buf, len, offset);
+
+	if (hw->mode == HWIO_RECORD && n >= 0) {
+		pthread_mutex_lock(&hw->lock);
+		fputs("R ", hw->trace);
+		put_path(hw->trace, path);
+		fprintf(hw->trace, " %llx ", (unsigned long long)offset);
+		put_hex(hw->trace, buf, (size_t)n);
+		fputc('\n', hw->trace);
+		pthread_mutex_unlock(&hw->lock);
+	}
+
+	return n;
+}
+
+off_t hwio_size(hwio_t *hw, const char *path)
+{
+	entry_t *e;
+	off_t size;
+
+	if (hw->mode == HWIO_REPLAY) {
+		if ((e = index_get(hw, path, false)) == NULL)
+			return -1;
+		return e->has_stat ? e->stat_size : (e->readable ? (off_t)e->size : -1);
+	}
+
+	size = real_size(path);
+
+	if (hw->mode == HWIO_RECORD && size >= 0) {
+		pthread_mutex_lock(&hw->lock);
+		fputs("S ", hw->trace);
+		put_path(hw->trace, path);
+		fprintf(hw->trace, " %llx\n", (unsigned long long)size);
+		pthread_mutex_unlock(&hw->lock);
+	}
+
+	return size;
+}
+
+bool hwio_write(hwio_t *hw, const char *path, const void *data, size_t len)
+{
+	entry_t *e;
+	bool ok;
+
+	if (hw->mode == HWIO_REPLAY)
+		return (e = index_get(hw, path, false)) != NULL && e->writable;
+
+	ok = real_write(path, data, len);
+
+	if (hw->mode == HWIO_RECORD && ok) {
+		pthread_mutex_lock(&hw->lock);
+		fputs("W ", hw->trace);
+		put_path(hw->trace, path);
+		fputc('\n', hw->trace);
+		pthread_mutex_unlock(&hw->lock);
+	}
+
+	return ok;
+}
+
+char **hwio_listdir(hwio_t *hw, const char *path, size_t *count)
+{
+	char **list;
+	entry_t *e;
+	size_t i;
+
+	if (hw->mode == HWIO_REPLAY) {
+		*count = 0;
+		if ((e = index_get(hw, path, false)) == NULL || !e->listable)
+			return NULL;
+		if ((list = calloc(e->nnames + 1, sizeof(char *))) == NULL)
+			return NULL;
+		for (i = 0; i < e->nnames; ++i)
+		{
+			if ((list[i] = strdup(e->names[i])) == NULL)
+				break;
+		}
+		*count = i;
+		return list;
+	}
+
+	list = real_listdir(path, count);
+
+	if (hw->mode == HWIO_RECORD && list != NULL) {
+		pthread_mutex_lock(&hw->lock);
+		fputs("D ", hw->trace);
+		put_path(hw->trace, path);
+		for (i = 0; i < *count; ++i)
+		{
+			fputc(' ', hw->trace);
+			put_path(hw->trace, list[i]);
+		}
+		fputc('\n', hw->trace);
+		pthread_mutex_unlock(&hw->lock);
+	}
+
+	return list;
+}
+
+void hwio_free_list(char **list, size_t count)
+{
+	size_t i;
+
+	for (i = 0; list && i < count; ++i)
+		free(list[i]);
+
+	free(list);
+}
+
+bool hwio_mmio_read(hwio_t *hw, const char *source, off_t base, size_t size,
+		    const unsigned int *regs, uint32_t *vals, size_t n)
+{
+	char key[1100];
+	entry_t *e;
+	size_t i;
+
+	if (hw->mode == HWIO_REPLAY) {
+		replay_wait(hw);
+		for (i = 0; i < n; ++i)
+		{
+			mmio_key(key, sizeof(key), source, base, regs[i]);
+			if ((e = index_get(hw, key, false)) == NULL || !e->has_value)
+				return false;
+			vals[i] = e->value;
+		}
+		return true;
+	}
+
+	if (!real_mmio_read(source, base, size, regs, vals, n))
+		return false;
+
+	if (hw->mode == HWIO_RECORD) {
+		pthread_mutex_lock(&hw->lock);
+		for (i = 0; i < n; ++i)
+		{
+			fputs("M ", hw->trace);
+			put_path(hw->trace, source);
+			fprintf(hw->trace, " %llx %x %x\n", (unsigned long long)base, regs[i], vals[i]);
+		}
+		pthread_mutex_unlock(&hw->lock);
+	}
+
+	return true;
+}
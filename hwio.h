@@ -0,0 +1,60 @@
+/*
+ * AMDGPUInfo - hardware access backends
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef HWIO_H
+#define HWIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Every sysfs read/write and register read of the probe goes through
+ * one of these, so a run on a real rig can be recorded into a trace
+ * file and replayed later without any GPU.
+ *
+ * Trace files are line based text, one operation per line:
+ *
+ *   R <path> <offset> <hex bytes>		data read from a file
+ *   S <path> <size>				size reported by stat()
+ *   W <path>					successful write
+ *   D <path> <name>...				directory listing
+ *   M <source> <base> <register> <value>	32-bit register read
+ *
+ * Numbers are hexadecimal and '%' and ' ' in paths are %-escaped.
+ * Anything not in the trace fails on replay, like a missing file would.
+ */
+typedef struct hwio hwio_t;
+
+hwio_t *hwio_real(void);
+hwio_t *hwio_record(const char *trace);
+hwio_t *hwio_replay(const char *trace);
+void hwio_close(hwio_t *hw);
+bool hwio_is_replay(const hwio_t *hw);
+
+/*
+ * Make every replayed file read and register batch take usec
+ * microseconds, so a benchmark sees something like hardware latency,
+ * and what probing in parallel hides of it, instead of a memcpy().
+ */
+void hwio_replay_latency(hwio_t *hw, unsigned int usec);
+
+ssize_t hwio_read(hwio_t *hw, const char *path, void *buf, size_t len, off_t offset);
+off_t hwio_size(hwio_t *hw, const char *path);
+bool hwio_write(hwio_t *hw, const char *path, const void *data, size_t len);
+char **hwio_listdir(hwio_t *hw, const char *path, size_t *count);
+void hwio_free_list(char **list, size_t count);
+
+/*
+ * Read the 32-bit registers with the given dword indexes from the size
+ * bytes of source (/dev/mem or a sysfs resource file) at base. Only the
+ * pages holding them are mapped, once for the whole batch.
+ */
+bool hwio_mmio_read(hwio_t *hw, const char *source, off_t base, size_t size,
+		    const unsigned int *regs, uint32_t *vals, size_t n);
+
+#endif
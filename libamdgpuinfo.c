@@ -0,0 +1,1105 @@
+/*
+ * AMDGPUInfo - probing library
+ *
+ * (C) 2014 Zuikkis <zuikkis@gmail.com>
+ * (C) 2018 Yann St.Arnaud <ystarnaud@gmail.com>
+ * (C) 2020 André Almeida <andrealmeid@riseup.net>
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <string.h>
+#include <pci/pci.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include "amdgpuinfo.h"
+#include "atom.h"
+#include "cache.h"
+#include "pool.h"
+#include "regs.h"
+#include "sysfs.h"
+
+#define SYSFS_PATH "/sys/bus/pci"
+
+// the probes that touch the hardware, and need the rom lock
+#define PROBE_HARDWARE (AMDGPUINFO_PROBE_VBIOS | AMDGPUINFO_PROBE_MEMORY)
+
+struct amdgpuinfo {
+	amdgpuinfo_config_t config;
+	char *sysfs_path, *cache_dir; // owned copies of the config strings
+	struct pci_access *pci; // only set up when needed
+	gpu_t *device_list, *last_device;
+	gpu_t **devs; // device_list in an array, for indexed access
+	size_t count;
+	rom_t *roms; // one VBIOS buffer per worker, kept across enumerations
+	unsigned int nroms;
+	bool use_cache; // for the current enumeration
+	char boot_id[40];
+	uint64_t time[TIME_RUN_PHASES];
+	struct probe_job *job; // only in the copies deadline probes run on
+};
+
+static bool job_publish(amdgpuinfo_t *ctx, const gpu_t *d);
+
+static void ctx_log(amdgpuinfo_t *ctx, int level, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static void ctx_log(amdgpuinfo_t *ctx, int level, const char *fmt, ...)
+{
+	va_list args;
+
+	if (ctx->config.log == NULL)
+		return;
+
+	va_start(args, fmt);
+	ctx->config.log(ctx->config.log_data, level, fmt, args);
+	va_end(args);
+}
+
+// a trace can neither hold libpci's config space reads nor a cached result
+static bool ctx_traced(const amdgpuinfo_t *ctx)
+{
+	return ctx->config.hw != hwio_real();
+}
+
+static struct pci_access *ctx_pci(amdgpuinfo_t *ctx)
+{
+	uint64_t t;
+
+	if (ctx->pci == NULL) {
+		t = timing_now();
+		ctx->pci = pci_alloc();
+		pci_set_param(ctx->pci, "sysfs.path", ctx->sysfs_path);
+		pci_init(ctx->pci);
+		ctx->time[TIME_PCI_INIT] += timing_now() - t;
+	}
+
+	return ctx->pci;
+}
+
+/**********************************************
+ * Device List
+ **********************************************/
+
+// add new device
+static gpu_t *new_device(void *arg)
+{
+	amdgpuinfo_t *ctx = arg;
+	gpu_t *d;
+
+	if ((d = (gpu_t *)malloc(sizeof(gpu_t))) == NULL) {
+		ctx_log(ctx, AMDGPUINFO_LOG_ERROR, "malloc() failed in new_device()\n");
+		return NULL;
+	}
+
+	// default values
+	d->gpu = NULL;
+	d->mem = NULL;
+	d->vbios = NULL;
+	d->path = NULL;
+	d->subsystem = NULL;
+	memset(d->bios_version, 0, 64);
+	memset(&d->fp, 0, sizeof(d->fp));
+	d->rom_status = FP_UNCHECKED;
+	d->next = d->prev = NULL;
+	d->mem_manufacturer = 0;
+	d->mem_model = 0;
+	d->memconfig = 0;
+	d->mem_type = 0;
+	d->mmio_failed = false;
+	d->cached = false;
+	d->timed_out = false;
+	memset(d->time, 0, sizeof(d->time));
+
+	if (ctx->device_list == NULL && ctx->last_device == NULL) {
+		ctx->device_list = ctx->last_device = d;
+	} else {
+		ctx->last_device->next = d;
+		d->prev = ctx->last_device;
+		ctx->last_device = d;
+	}
+
+	return d;
+}
+
+static void free_device(gpu_t *d)
+{
+	if (d->path != NULL) {
+		free(d->path);
+	}
+
+	if (d->subsystem != NULL) {
+		free(d->subsystem);
+	}
+
+	free((void *)d);
+}
+
+// free device memory
+static void free_devices(amdgpuinfo_t *ctx)
+{
+	gpu_t *d;
+
+	while(ctx->last_device)
+	{
+		d = ctx->last_device;
+		ctx->last_device = d->prev;
+		free_device(d);
+	}
+
+	ctx->last_device = ctx->device_list = NULL;
+
+	free(ctx->devs);
+	ctx->devs = NULL;
+	ctx->count = 0;
+}
+
+/***********************************************
+ * Device selection
+ ***********************************************/
+static bool select_match(const amdgpuinfo_select_t *s, const gpu_t *d)
+{
+	if (s->by_id)
+		return d->vendor_id == s->vendor_id && d->device_id == s->device_id;
+
+	return d->pcidomain == s->domain && d->pcibus == s->bus &&
+	       d->pcidev == s->dev && d->pcifunc == s->func;
+}
+
+static bool selected(const amdgpuinfo_t *ctx, const gpu_t *d)
+{
+	size_t i;
+
+	if (ctx->config.nselect == 0)
+		return true;
+
+	for (i = 0; i < ctx->config.nselect; ++i) {
+		if (select_match(&ctx->config.select[i], d))
+			return true;
+	}
+
+	return false;
+}
+
+// drop the devices no selector matches, before anything is probed
+static void select_devices(amdgpuinfo_t *ctx)
+{
+	gpu_t *d, *next;
+
+	for (d = ctx->device_list; d; d = next)
+	{
+		next = d->next;
+
+		if (selected(ctx, d))
+			continue;
+
+		if (d->prev)
+			d->prev->next = d->next;
+		else
+			ctx->device_list = d->next;
+
+		if (d->next)
+			d->next->prev = d->prev;
+		else
+			ctx->last_device = d->prev;
+
+		free_device(d);
+	}
+}
+
+/*
+ * When only addresses are selected, go straight to their directories.
+ * Returns false if that did not find anything, a full enumeration can
+ * still tell, e.g. when sysfs is not there and libpci has to step in.
+ */
+static bool enumerate_selected(amdgpuinfo_t *ctx)
+{
+	const amdgpuinfo_select_t *s;
+	char name[32];
+	size_t i, j;
+	int added = 0;
+
+	if (ctx->config.nselect == 0 || ctx->config.libpci)
+		return false;
+
+	for (i = 0; i < ctx->config.nselect; ++i) {
+		if (ctx->config.select[i].by_id)
+			return false;
+	}
+
+	for (i = 0; i < ctx->config.nselect; ++i)
+	{
+		s = &ctx->config.select[i];
+
+		// the same address twice is still one device
+		for (j = 0; j < i; ++j) {
+			if (ctx->config.select[j].domain == s->domain && ctx->config.select[j].bus == s->bus &&
+			    ctx->config.select[j].dev == s->dev && ctx->config.select[j].func == s->func)
+				break;
+		}
+		if (j < i)
+			continue;
+
+		snprintf(name, sizeof(name), "%04x:%02x:%02x.%x", s->domain, s->bus, s->dev, s->func);
+		if (sysfs_add_device(ctx->config.hw, ctx->sysfs_path, name, new_device, ctx) > 0)
+			++added;
+	}
+
+	return added > 0;
+}
+
+/***********************************************
+ * VBIOS functions
+ ***********************************************/
+static size_t dump_vbios(amdgpuinfo_t *ctx, gpu_t *gpu, rom_t *rom)
+{
+	int ret = rom_read_device(rom, ctx->config.hw, gpu->path);
+
+	gpu->time[TIME_DEV_UNLOCK] = rom->unlock_ns;
+	gpu->time[TIME_DEV_ROM] = rom->read_ns;
+	gpu->time[TIME_DEV_RELOCK] = rom->relock_ns;
+
+	switch (ret) {
+	case ROM_OK:
+		break;
+	case ROM_SHORT:
+		ctx_log(ctx, AMDGPUINFO_LOG_ERROR, "%02x:%02x.%x: Short vbios read, got %zu of %zu bytes\n", gpu->pcibus, gpu->pcidev, gpu->pcifunc, rom->size, rom->expected);
+		break;
+	case ROM_ERR_UNLOCK:
+		ctx_log(ctx, AMDGPUINFO_LOG_ERROR, "%02x:%02x.%x: Unable to unlock vbios (try running as root)\n", gpu->pcibus, gpu->pcidev, gpu->pcifunc);
+		return 0;
+	case ROM_ERR_NOMEM:
+		ctx_log(ctx, AMDGPUINFO_LOG_ERROR, "%02x:%02x.%x: Unable to allocate memory for vbios\n", gpu->pcibus, gpu->pcidev, gpu->pcifunc);
+		return 0;
+	case ROM_ERR_INVALID:
+		ctx_log(ctx, AMDGPUINFO_LOG_ERROR, "%02x:%02x.%x: Invalid vbios signature\n", gpu->pcibus, gpu->pcidev, gpu->pcifunc);
+		return 0;
+	default:
+		ctx_log(ctx, AMDGPUINFO_LOG_ERROR, "%02x:%02x.%x: Unable to read vbios\n", gpu->pcibus, gpu->pcidev, gpu->pcifunc);
+		return 0;
+	}
+
+	if (rom->relock_failed) {
+		ctx_log(ctx, AMDGPUINFO_LOG_ERROR, "%02x:%02x.%x: Unable to relock vbios\n", gpu->pcibus, gpu->pcidev, gpu->pcifunc);
+	}
+
+	gpu->vbios = rom;
+
+	return rom->size;
+}
+
+static void get_bios_version(gpu_t *gpu)
+{
+	rom_get_version(gpu->vbios, gpu->bios_version, sizeof(gpu->bios_version));
+}
+
+/***********************************************
+ * Probe engine
+ ***********************************************/
+
+// read the memory configuration register through the register BAR
+static void probe_memory(amdgpuinfo_t *ctx, gpu_t *d, const asic_regs_t *regs)
+{
+	int i, manufacturer, model, mem_type;
+	uint32_t vals[REG_COUNT], meminfo;
+
+	for (i=6;--i;) {
+		if (d->size[i] == REGS_BAR_SIZE) {
+			if (regs_read(ctx->config.hw, d, i, regs, vals)) {
+				meminfo = vals[REG_MC_SEQ_MISC0];
+				mem_type = (meminfo & 0xf0000000) >> 28;
+				manufacturer = (meminfo & 0xf00) >> 8;
+				model = (meminfo & 0xf000) >> 12;
+
+				d->memconfig = meminfo;
+				d->mem_type = mem_type;
+				d->mem_manufacturer = manufacturer;
+				d->mem_model = model;
+				d->mem = find_mem(mem_type, manufacturer, model);
+			} else {
+				d->mmio_failed = true;
+			}
+
+			// memory model found so exit loop
+			if (d->mem != NULL)
+				break;
+		}
+	}
+}
+
+// amdgpu's names for the vendors in mem_info_vram_vendor, by VRAM_Info vendor
+static const char *vram_vendor_names[16] = {
+	[0x1] = "samsung",
+	[0x2] = "infineon",
+	[0x3] = "elpida",
+	[0x4] = "etron",
+	[0x5] = "nanya",
+	[0x6] = "hynix",
+	[0x7] = "mosel",
+	[0x8] = "winbond",
+	[0x9] = "esmt",
+	[0xf] = "micron",
+};
+
+// vendor of the memory the driver found, -1 without amdgpu or if it does not know
+static int sysfs_vram_vendor(amdgpuinfo_t *ctx, const gpu_t *d)
+{
+	char buf[32];
+	int i;
+
+	if (d->path == NULL || !sysfs_read_attr(ctx->config.hw, d->path, "mem_info_vram_vendor", buf, sizeof(buf)))
+		return -1;
+
+	for (i = 0; i < 16; ++i) {
+		if (vram_vendor_names[i] && !strcmp(buf, vram_vendor_names[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Index of the VRAM_Info module for the memory strap of the board, as
+ * amdgpu finds it: bits 23:16 of BIOS_SCRATCH_4, the ext_memory_id, with
+ * the scratch registers where FirmwareInfo says. Failing that, the one
+ * module of the vendor amdgpu reports. -1 if neither tells.
+ */
+static int vram_strap(amdgpuinfo_t *ctx, const gpu_t *d, atom_t *atom,
+		      const atom_vram_module_t *modules, size_t n)
+{
+	uint32_t vals[REG_COUNT], start, strap;
+	asic_regs_t scratch;
+	int i, vendor, found = -1;
+	size_t m;
+
+	if (atom_bios_scratch_start(atom, &start)) {
+		// not in the register table, only the VBIOS knows where it is
+		memset(&scratch, 0, sizeof(scratch));
+		scratch.offset[REG_BIOS_SCRATCH_4] = start + 4;
+		for (i = 6; --i;) {
+			if (d->size[i] == REGS_BAR_SIZE) {
+				if (regs_read(ctx->config.hw, d, i, &scratch, vals) &&
+				    (strap = (vals[REG_BIOS_SCRATCH_4] >> 16) & 0xff) < n)
+					return (int)strap;
+				break;
+			}
+		}
+	}
+
+	if ((vendor = sysfs_vram_vendor(ctx, d)) < 0)
+		return -1;
+
+	for (m = 0; m < n; ++m) {
+		if (modules[m].vendor != vendor)
+			continue;
+		// two parts of the same vendor, the name does not say which
+		if (found >= 0 && modules[m].revision != modules[found].revision)
+			return -1;
+		found = (int)m;
+	}
+
+	return found;
+}
+
+/*
+ * Memory type and vendor from the VRAM_Info table of the VBIOS. Boards
+ * list a module per memory strap, if those disagree on the vendor the
+ * one in use has to be found out, or only the type is certain.
+ */
+static bool probe_rom_memory(amdgpuinfo_t *ctx, gpu_t *d)
+{
+	atom_vram_module_t modules[ATOM_MAX_VRAM_MODULES];
+	bool same_vendor = true;
+	int strap = 0;
+	atom_t atom;
+	size_t i, n;
+
+	if (d->vbios == NULL || !atom_init(&atom, d->vbios) ||
+	    (n = atom_vram_modules(&atom, modules, ATOM_MAX_VRAM_MODULES)) == 0)
+		return false;
+
+	for (i = 1; i < n; ++i) {
+		if (modules[i].type != modules[0].type)
+			return false;
+		if (modules[i].vendor != modules[0].vendor || modules[i].revision != modules[0].revision)
+			same_vendor = false;
+	}
+
+	if (!same_vendor)
+		strap = vram_strap(ctx, d, &atom, modules, n);
+
+	d->mem_type = modules[0].type;
+
+	if (strap >= 0) {
+		d->mem_manufacturer = modules[strap].vendor;
+		d->mem_model = modules[strap].revision;
+		d->memconfig = (int)(((unsigned int)modules[strap].type << 28) |
+				     ((unsigned int)modules[strap].revision << 12) |
+				     ((unsigned int)modules[strap].vendor << 8));
+		d->mem = find_mem(d->mem_type, d->mem_manufacturer, d->mem_model);
+	} else {
+		d->mem_manufacturer = 0;
+		d->mem_model = 0;
+		d->memconfig = (int)((unsigned int)modules[0].type << 28);
+		d->mem = find_mem(d->mem_type, -1, -1);
+	}
+
+	return true;
+}
+
+/*
+ * All per-device work: table lookup, VBIOS read and memory detection,
+ * as far as the probe plan asks for them. Only touches its own gpu_t
+ * and rom, so devices can be probed concurrently.
+ */
+static void probe_one(amdgpuinfo_t *ctx, gpu_t *d, rom_t *rom)
+{
+	unsigned int probes = ctx->config.probes;
+	uint64_t start, t;
+	bool rom_memory = false, has_reg;
+	const asic_regs_t *regs;
+	int vendor;
+
+	start = timing_now();
+
+	d->gpu = find_gpu(d->device_id, d->subdevice, d->pcirev);
+	if (!d->gpu) {
+		ctx_log(ctx, AMDGPUINFO_LOG_INFO, "AMD card found, but model not found.\n");
+		d->time[TIME_DEV_TOTAL] = timing_now() - start;
+		return;
+	}
+
+	if (!job_publish(ctx, d))
+		return;
+
+	regs = asic_regs(d->gpu->asic_type);
+	has_reg = asic_has_reg(regs, REG_MC_SEQ_MISC0);
+
+	// where there is no memory register, the VBIOS is the only source
+	if (((probes & AMDGPUINFO_PROBE_VBIOS) || ((probes & AMDGPUINFO_PROBE_MEMORY) && !has_reg)) &&
+	    dump_vbios(ctx, d, rom)) {
+		t = timing_now();
+		if (probes & AMDGPUINFO_PROBE_VBIOS) {
+			get_bios_version(d);
+			fingerprint_rom(&d->fp, d->vbios);
+		}
+		if (probes & AMDGPUINFO_PROBE_MEMORY)
+			rom_memory = probe_rom_memory(ctx, d);
+		d->time[TIME_DEV_PARSE] = timing_now() - t;
+	}
+
+	if (!job_publish(ctx, d) || !(probes & AMDGPUINFO_PROBE_MEMORY)) {
+		d->vbios = NULL;
+		d->time[TIME_DEV_TOTAL] = timing_now() - start;
+		return;
+	}
+
+	t = timing_now();
+
+	if (has_reg) {
+		// the register is what the MC actually uses, so it wins over the VBIOS
+		probe_memory(ctx, d, regs);
+	} else if (!rom_memory && (d->gpu->asic_type == CHIP_VEGA10 || d->gpu->asic_type == CHIP_VEGA20)) {
+		// without the VBIOS Vega uses HBM, of the vendor amdgpu found if it is loaded
+		if ((vendor = sysfs_vram_vendor(ctx, d)) >= 0) {
+			d->memconfig = (MEM_HBM << 28) | (vendor << 8);
+			d->mem_manufacturer = vendor;
+			d->mem = find_mem(MEM_HBM, vendor, -1);
+		} else {
+			d->memconfig = MEM_HBM << 28;
+			d->mem = find_mem(MEM_HBM, -1, -1);
+		}
+		d->mem_type = MEM_HBM;
+	}
+
+	d->time[TIME_DEV_MMIO] = timing_now() - t;
+	d->time[TIME_DEV_TOTAL] = timing_now() - start;
+
+	d->vbios = NULL;
+}
+
+// only complete results are worth keeping, a root run fills in the rest
+static void store_device(amdgpuinfo_t *ctx, const gpu_t *d)
+{
+	if ((ctx->config.probes & PROBE_HARDWARE) == PROBE_HARDWARE &&
+	    !d->cached && d->gpu && d->bios_version[0] && !d->mmio_failed)
+		cache_store(ctx->cache_dir, ctx->boot_id, d);
+}
+
+/*
+ * Probe a device holding its rom lock, and publish the result before
+ * letting go. Processes that queued up on the lock meanwhile find it in
+ * the cache when reuse is set, so a burst of callers costs one probe.
+ */
+static void probe_locked(amdgpuinfo_t *ctx, gpu_t *d, rom_t *rom, bool reuse)
+{
+	uint64_t t, wait;
+	int lock;
+
+	// the tables alone leave the hardware alone
+	if (!(ctx->config.probes & PROBE_HARDWARE)) {
+		probe_one(ctx, d, rom);
+		return;
+	}
+
+	t = timing_now();
+	lock = rom_lock_device(ctx->config.hw, d->path);
+	wait = timing_now() - t;
+
+	if (!(reuse && ctx->use_cache && lock >= 0 &&
+	      cache_load(ctx->cache_dir, ctx->boot_id, d))) {
+		probe_one(ctx, d, rom);
+		if (ctx->use_cache)
+			store_device(ctx, d);
+	}
+
+	rom_unlock_device(lock);
+
+	d->time[TIME_DEV_WAIT] = wait;
+}
+
+/***********************************************
+ * Deadlines
+ ***********************************************/
+
+/*
+ * A probe running on its own thread, on a copy of the context and the
+ * device, so it can be left behind when it misses its deadline. Both
+ * sides hold a reference, whoever lets go last frees it.
+ */
+typedef struct probe_job {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	amdgpuinfo_t shadow;
+	amdgpuinfo_log_fn_t log;
+	void *log_data;
+	gpu_t work;	// written by the probe thread
+	gpu_t result;	// what work held at the last phase boundary
+	rom_t rom;
+	bool reuse, done, abandoned;
+	int refs;
+} probe_job_t;
+
+// what a probe finds out, leaving the list links and strings alone
+static void copy_result(gpu_t *dst, const gpu_t *src)
+{
+	dst->gpu = src->gpu;
+	dst->mem = src->mem;
+	dst->memconfig = src->memconfig;
+	dst->mem_type = src->mem_type;
+	dst->mem_manufacturer = src->mem_manufacturer;
+	dst->mem_model = src->mem_model;
+	dst->mmio_failed = src->mmio_failed;
+	dst->cached = src->cached;
+	memcpy(dst->bios_version, src->bios_version, sizeof(dst->bios_version));
+	dst->fp = src->fp;
+	memcpy(dst->time, src->time, sizeof(dst->time));
+}
+
+// hand over a phase, false once nobody is waiting for the results anymore
+static bool job_publish(amdgpuinfo_t *ctx, const gpu_t *d)
+{
+	probe_job_t *job = ctx->job;
+	bool wanted;
+
+	if (job == NULL)
+		return true;
+
+	pthread_mutex_lock(&job->lock);
+	if ((wanted = !job->abandoned))
+		copy_result(&job->result, d);
+	pthread_mutex_unlock(&job->lock);
+
+	return wanted;
+}
+
+// an abandoned probe has nobody to report to
+static void job_log(void *data, int level, const char *fmt, va_list args)
+{
+	probe_job_t *job = data;
+
+	pthread_mutex_lock(&job->lock);
+	if (!job->abandoned && job->log != NULL)
+		job->log(job->log_data, level, fmt, args);
+	pthread_mutex_unlock(&job->lock);
+}
+
+static void job_release(probe_job_t *job)
+{
+	bool last;
+
+	last = --job->refs == 0;
+	pthread_mutex_unlock(&job->lock);
+
+	if (!last)
+		return;
+
+	pthread_cond_destroy(&job->cond);
+	pthread_mutex_destroy(&job->lock);
+	rom_free(&job->rom);
+	free(job->work.path);
+	free(job->shadow.cache_dir);
+	free(job);
+}
+
+static void *job_thread(void *data)
+{
+	probe_job_t *job = data;
+
+	probe_locked(&job->shadow, &job->work, &job->rom, job->reuse);
+
+	pthread_mutex_lock(&job->lock);
+	job->done = true;
+	pthread_cond_signal(&job->cond);
+	job_release(job);
+
+	return NULL;
+}
+
+static probe_job_t *job_new(amdgpuinfo_t *ctx, const gpu_t *d, bool reuse)
+{
+	pthread_condattr_t attr;
+	probe_job_t *job;
+
+	if ((job = (probe_job_t *)calloc(1, sizeof(probe_job_t))) == NULL)
+		return NULL;
+
+	// only the fields the probe reads, nothing of ctx that may go away
+	job->shadow.config = ctx->config;
+	job->shadow.config.log = job_log;
+	job->shadow.config.log_data = job;
+	job->shadow.use_cache = ctx->use_cache;
+	memcpy(job->shadow.boot_id, ctx->boot_id, sizeof(job->shadow.boot_id));
+	job->shadow.job = job;
+	job->log = ctx->config.log;
+	job->log_data = ctx->config.log_data;
+
+	job->work = *d;
+	job->work.path = d->path ? strdup(d->path) : NULL;
+	job->work.subsystem = NULL;
+	job->work.prev = job->work.next = NULL;
+	job->shadow.cache_dir = ctx->cache_dir ? strdup(ctx->cache_dir) : NULL;
+	job->result = job->work;
+	job->reuse = reuse;
+	job->refs = 2;
+
+	if ((d->path && job->work.path == NULL) || (ctx->cache_dir && job->shadow.cache_dir == NULL)) {
+		free(job->work.path);
+		free(job->shadow.cache_dir);
+		free(job);
+		return NULL;
+	}
+
+	pthread_mutex_init(&job->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&job->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	return job;
+}
+
+/*
+ * probe_locked() on a thread of its own, waiting for it at most
+ * timeout_ms. Falls back to probing right here if no thread can be had.
+ */
+static void probe_deadline(amdgpuinfo_t *ctx, gpu_t *d, rom_t *rom, bool reuse)
+{
+	unsigned int ms = ctx->config.timeout_ms;
+	pthread_attr_t attr;
+	struct timespec deadline;
+	probe_job_t *job;
+	pthread_t thread;
+	uint64_t start = timing_now();
+	int err = 0;
+
+	if ((job = job_new(ctx, d, reuse)) == NULL) {
+		probe_locked(ctx, d, rom, reuse);
+		return;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, job_thread, job) != 0) {
+		pthread_attr_destroy(&attr);
+		job->refs = 1;
+		pthread_mutex_lock(&job->lock);
+		job_release(job);
+		probe_locked(ctx, d, rom, reuse);
+		return;
+	}
+	pthread_attr_destroy(&attr);
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += ms / 1000;
+	deadline.tv_nsec += (long)(ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		++deadline.tv_sec;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&job->lock);
+	while (!job->done && err != ETIMEDOUT)
+		err = pthread_cond_timedwait(&job->cond, &job->lock, &deadline);
+
+	if (job->done) {
+		copy_result(d, &job->work);
+	} else {
+		copy_result(d, &job->result);
+		// it may not even have got past the rom lock, the tables are no hardware
+		if (d->gpu == NULL)
+			d->gpu = find_gpu(d->device_id, d->subdevice, d->pcirev);
+		d->timed_out = true;
+		d->time[TIME_DEV_TOTAL] = timing_now() - start;
+		job->abandoned = true;
+	}
+	job_release(job);
+
+	// the thread may be stuck with the ROM enabled, do not leave it so
+	if (d->timed_out && d->path != NULL)
+		rom_disable_device(ctx->config.hw, d->path);
+
+	if (d->timed_out)
+		ctx_log(ctx, AMDGPUINFO_LOG_ERROR, "%02x:%02x.%x: Probe timed out after %u ms, results are partial\n",
+			d->pcibus, d->pcidev, d->pcifunc, ms);
+}
+
+// a trace can not hang, and its hwio goes away with the run
+static void probe_device_once(amdgpuinfo_t *ctx, gpu_t *d, rom_t *rom, bool reuse)
+{
+	if (ctx->config.timeout_ms > 0 && !ctx_traced(ctx))
+		probe_deadline(ctx, d, rom, reuse);
+	else
+		probe_locked(ctx, d, rom, reuse);
+}
+
+static void probe_device(void *arg, size_t index, unsigned int worker)
+{
+	amdgpuinfo_t *ctx = arg;
+	gpu_t *d = ctx->devs[index];
+
+	if (!d->cached)
+		probe_device_once(ctx, d, &ctx->roms[worker], true);
+}
+
+static int compare_devices(const void *a, const void *b)
+{
+	const gpu_t *x = *(const gpu_t **)a, *y = *(const gpu_t **)b;
+
+	if (x->pcidomain != y->pcidomain)
+		return x->pcidomain - y->pcidomain;
+	if (x->pcibus != y->pcibus)
+		return x->pcibus - y->pcibus;
+	if (x->pcidev != y->pcidev)
+		return x->pcidev - y->pcidev;
+	return x->pcifunc - y->pcifunc;
+}
+
+// make sure there is a VBIOS buffer for every worker
+static bool reserve_roms(amdgpuinfo_t *ctx, unsigned int workers)
+{
+	rom_t *roms;
+
+	if (workers <= ctx->nroms)
+		return true;
+
+	if ((roms = (rom_t *)realloc(ctx->roms, sizeof(rom_t) * workers)) == NULL)
+		return false;
+
+	memset(roms + ctx->nroms, 0, sizeof(rom_t) * (workers - ctx->nroms));
+	ctx->roms = roms;
+	ctx->nroms = workers;
+
+	return true;
+}
+
+/*
+ * Put the devices in PCI order, so output does not depend on
+ * enumeration order, and keep that order in an array too.
+ */
+static bool index_devices(amdgpuinfo_t *ctx)
+{
+	gpu_t *d;
+	size_t i, count = 0;
+
+	for (d = ctx->device_list; d; d = d->next)
+		++count;
+
+	if (count == 0)
+		return true;
+
+	if ((ctx->devs = (gpu_t **)malloc(sizeof(gpu_t *) * count)) == NULL) {
+		ctx_log(ctx, AMDGPUINFO_LOG_ERROR, "malloc() failed in index_devices()\n");
+		return false;
+	}
+
+	for (i = 0, d = ctx->device_list; d; d = d->next)
+		ctx->devs[i++] = d;
+
+	qsort(ctx->devs, count, sizeof(gpu_t *), compare_devices);
+
+	ctx->device_list = ctx->devs[0];
+	ctx->last_device = ctx->devs[count - 1];
+	for (i = 0; i < count; ++i) {
+		ctx->devs[i]->prev = (i > 0) ? ctx->devs[i - 1] : NULL;
+		ctx->devs[i]->next = (i + 1 < count) ? ctx->devs[i + 1] : NULL;
+	}
+
+	ctx->count = count;
+
+	return true;
+}
+
+// probe every device on a bounded worker pool
+static void probe_devices(amdgpuinfo_t *ctx)
+{
+	unsigned int workers;
+
+	if (ctx->count == 0)
+		return;
+
+	workers = pool_workers(ctx->config.jobs, ctx->count);
+	if (!reserve_roms(ctx, workers)) {
+		ctx_log(ctx, AMDGPUINFO_LOG_ERROR, "malloc() failed in probe_devices()\n");
+		return;
+	}
+
+	pool_run(workers, ctx->count, probe_device, ctx);
+}
+
+// fallback enumeration through a full libpci bus scan
+static void enumerate_libpci(amdgpuinfo_t *ctx)
+{
+	struct pci_access *pci = ctx_pci(ctx);
+	struct pci_dev *pcidev;
+	char buf[1024];
+	gpu_t *d;
+	int i;
+
+	pci_scan_bus(pci);
+
+	for (pcidev = pci->devices; pcidev; pcidev = pcidev->next)
+	{
+		if (((pcidev->device_class & 0xff00) >> 8) == PCI_BASE_CLASS_DISPLAY && pcidev->vendor_id == AMD_PCI_VENDOR_ID) {
+
+			// skip APUs
+			if (is_apu(pcidev->device_id))
+				continue;
+
+			if ((d = new_device(ctx)) != NULL) {
+				d->vendor_id = AMD_PCI_VENDOR_ID;
+				d->device_id = pcidev->device_id;
+				d->pcidomain = pcidev->domain;
+				d->pcibus = pcidev->bus;
+				d->pcidev = pcidev->dev;
+				d->pcifunc = pcidev->func;
+				d->subvendor = pci_read_word(pcidev, PCI_SUBSYSTEM_VENDOR_ID);
+				d->subdevice = pci_read_word(pcidev, PCI_SUBSYSTEM_ID);
+				d->pcirev = pci_read_byte(pcidev, PCI_REVISION_ID);
+
+				for (i = 0; i < 6; ++i) {
+					d->base_addr[i] = pcidev->base_addr[i];
+					d->size[i] = pcidev->size[i];
+				}
+
+				memset(buf, 0, 1024);
+				sprintf(buf, "%s/devices/%04x:%02x:%02x.%d", ctx->sysfs_path, pcidev->domain, pcidev->bus, pcidev->dev, pcidev->func);
+				d->path = strdup(buf);
+			}
+		}
+	}
+}
+
+/***********************************************
+ * Context
+ ***********************************************/
+void amdgpuinfo_config_init(amdgpuinfo_config_t *config)
+{
+	memset(config, 0, sizeof(*config));
+	config->cache_dir = CACHE_DIR;
+	config->probes = PROBE_HARDWARE;
+	config->pci_ids = true;
+}
+
+amdgpuinfo_t *amdgpuinfo_new(const amdgpuinfo_config_t *config)
+{
+	amdgpuinfo_t *ctx;
+
+	if ((ctx = (amdgpuinfo_t *)calloc(1, sizeof(amdgpuinfo_t))) == NULL)
+		return NULL;
+
+	ctx->config = *config;
+	if (ctx->config.hw == NULL)
+		ctx->config.hw = hwio_real();
+
+	ctx->sysfs_path = strdup(config->sysfs_path ? config->sysfs_path : SYSFS_PATH);
+	ctx->cache_dir = config->cache_dir ? strdup(config->cache_dir) : NULL;
+
+	if (ctx->sysfs_path == NULL || (config->cache_dir && ctx->cache_dir == NULL)) {
+		amdgpuinfo_free(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
+void amdgpuinfo_free(amdgpuinfo_t *ctx)
+{
+	unsigned int i;
+
+	if (ctx == NULL)
+		return;
+
+	free_devices(ctx);
+
+	for (i = 0; i < ctx->nroms; ++i)
+		rom_free(&ctx->roms[i]);
+	free(ctx->roms);
+
+	if (ctx->pci != NULL)
+		pci_cleanup(ctx->pci);
+
+	free(ctx->sysfs_path);
+	free(ctx->cache_dir);
+	free(ctx);
+}
+
+int amdgpuinfo_enumerate(amdgpuinfo_t *ctx)
+{
+	uint64_t t;
+	bool listed = true;
+	gpu_t *d;
+
+	free_devices(ctx);
+
+	t = timing_now();
+
+	// libpci is only needed to enumerate when sysfs can not be listed,
+	// it reads config space behind our back so a trace can not hold it
+	if (enumerate_selected(ctx)) {
+		// nothing else to look at
+	} else if (ctx_traced(ctx)) {
+		if (sysfs_enumerate(ctx->config.hw, ctx->sysfs_path, new_device, ctx) < 0) {
+			ctx_log(ctx, AMDGPUINFO_LOG_ERROR, "Unable to list %s/devices\n", ctx->sysfs_path);
+			listed = false;
+		}
+	} else if (ctx->config.libpci || sysfs_enumerate(ctx->config.hw, ctx->sysfs_path, new_device, ctx) < 0) {
+		enumerate_libpci(ctx);
+	}
+
+	select_devices(ctx);
+
+	ctx->time[TIME_ENUMERATE] += timing_now() - t;
+
+	if (!index_devices(ctx))
+		return -1;
+
+	t = timing_now();
+
+	// a trace must see the real probe, and a replay is not this boot
+	ctx->use_cache = ctx->cache_dir != NULL && (ctx->config.probes & PROBE_HARDWARE) &&
+			 !ctx_traced(ctx) && cache_boot_id(ctx->boot_id, sizeof(ctx->boot_id));
+
+	if (ctx->use_cache) {
+		for (d = ctx->device_list; d; d = d->next)
+			cache_load(ctx->cache_dir, ctx->boot_id, d);
+	}
+
+	ctx->time[TIME_CACHE] += timing_now() - t;
+	t = timing_now();
+	probe_devices(ctx);
+	ctx->time[TIME_PROBE] += timing_now() - t;
+
+	for (d = ctx->device_list; d; d = d->next)
+		d->rom_status = fingerprint_check(ctx->config.catalog, d->bios_version, &d->fp);
+
+	if (ctx->config.probes & AMDGPUINFO_PROBE_NAMES)
+		amdgpuinfo_lookup_names(ctx);
+
+	return listed ? (int)ctx->count : -1;
+}
+
+size_t amdgpuinfo_count(const amdgpuinfo_t *ctx)
+{
+	return ctx->count;
+}
+
+const gpu_t *amdgpuinfo_device(const amdgpuinfo_t *ctx, size_t index)
+{
+	return index < ctx->count ? ctx->devs[index] : NULL;
+}
+
+const gpu_t *amdgpuinfo_devices(const amdgpuinfo_t *ctx)
+{
+	return ctx->device_list;
+}
+
+bool amdgpuinfo_refresh(amdgpuinfo_t *ctx, size_t index)
+{
+	uint64_t t;
+	gpu_t *d;
+
+	if (index >= ctx->count || !reserve_roms(ctx, 1))
+		return false;
+
+	d = ctx->devs[index];
+	d->gpu = NULL;
+	d->mem = NULL;
+	memset(d->bios_version, 0, sizeof(d->bios_version));
+	memset(&d->fp, 0, sizeof(d->fp));
+	d->memconfig = d->mem_type = d->mem_manufacturer = d->mem_model = 0;
+	d->mmio_failed = false;
+	d->cached = false;
+	d->timed_out = false;
+	memset(d->time, 0, sizeof(d->time));
+
+	ctx->use_cache = ctx->cache_dir != NULL && (ctx->config.probes & PROBE_HARDWARE) &&
+			 !ctx_traced(ctx) && cache_boot_id(ctx->boot_id, sizeof(ctx->boot_id));
+
+	t = timing_now();
+	probe_device_once(ctx, d, &ctx->roms[0], false);
+	ctx->time[TIME_PROBE] += timing_now() - t;
+
+	d->rom_status = fingerprint_check(ctx->config.catalog, d->bios_version, &d->fp);
+
+	return d->gpu != NULL;
+}
+
+void amdgpuinfo_lookup_names(amdgpuinfo_t *ctx)
+{
+	const char *name;
+	char buf[1024];
+	uint64_t t;
+	gpu_t *d;
+
+	if (ctx->device_list == NULL)
+		return;
+
+	t = timing_now();
+
+	// pci.ids is over 1 MB to parse, so it only comes up for a vendor the table misses
+	for (d = ctx->device_list; d; d = d->next) {
+		if (d->subsystem != NULL)
+			continue;
+		if ((name = subvendor_name(d->subvendor)) != NULL)
+			d->subsystem = strdup(name);
+		else if (ctx->config.pci_ids &&
+			 pci_lookup_name(ctx_pci(ctx), buf, sizeof(buf),
+					 PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR,
+					 d->subvendor) != NULL)
+			d->subsystem = strdup(buf);
+	}
+
+	ctx->time[TIME_NAMES] += timing_now() - t;
+}
+
+const uint64_t *amdgpuinfo_timings(const amdgpuinfo_t *ctx)
+{
+	return ctx->time;
+}
@@ -0,0 +1,858 @@
+/*
+ * AMDGPUInfo - output backends
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "output.h"
+
+/***********************************************
+ * Record buffer
+ ***********************************************/
+void outbuf_init(outbuf_t *out, int fd)
+{
+	out->data = NULL;
+	out->len = out->alloc = 0;
+	out->fd = fd;
+	out->failed = false;
+}
+
+void outbuf_free(outbuf_t *out)
+{
+	free(out->data);
+	outbuf_init(out, out->fd);
+}
+
+static bool outbuf_reserve(outbuf_t *out, size_t len)
+{
+	size_t alloc;
+	char *data;
+
+	if (out->len + len < out->alloc)
+		return true;
+
+	alloc = out->alloc ? out->alloc : 1024;
+	while (alloc <= out->len + len)
+		alloc *= 2;
+
+	if ((data = realloc(out->data, alloc)) == NULL) {
+		out->failed = true;
+		return false;
+	}
+
+	out->data = data;
+	out->alloc = alloc;
+
+	return true;
+}
+
+void outbuf_write(outbuf_t *out, const char *data, size_t len)
+{
+	if (!outbuf_reserve(out, len))
+		return;
+
+	memcpy(out->data + out->len, data, len);
+	out->len += len;
+	out->data[out->len] = 0;
+}
+
+void outbuf_puts(outbuf_t *out, const char *str)
+{
+	outbuf_write(out, str, strlen(str));
+}
+
+void outbuf_printf(outbuf_t *out, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	// most records fit in what is left, so try once before growing
+	va_start(args, fmt);
+	n = vsnprintf(out->data ? out->data + out->len : NULL,
+		      out->data ? out->alloc - out->len : 0, fmt, args);
+	va_end(args);
+
+	if (n < 0) {
+		out->failed = true;
+		return;
+	}
+
+	if (out->data == NULL || (size_t)n >= out->alloc - out->len) {
+		if (!outbuf_reserve(out, (size_t)n))
+			return;
+
+		va_start(args, fmt);
+		vsnprintf(out->data + out->len, out->alloc - out->len, fmt, args);
+		va_end(args);
+	}
+
+	out->len += (size_t)n;
+}
+
+// hand everything collected so far to the kernel and start over
+bool outbuf_flush(outbuf_t *out)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < out->len)
+	{
+		n = write(out->fd, out->data + done, out->len - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			out->failed = true;
+			break;
+		}
+		done += (size_t)n;
+	}
+
+	out->len = 0;
+
+	return !out->failed;
+}
+
+/***********************************************
+ * Fields shared by the structured formats
+ ***********************************************/
+typedef enum {
+	FIELD_STRING,
+	FIELD_NUMBER,
+	FIELD_BOOLEAN,
+} field_type_t;
+
+typedef struct {
+	const char *name;
+	field_type_t type;
+	void (*get)(const gpu_t *gpu, char *buf, size_t len);
+	unsigned int probes; // AMDGPUINFO_PROBE_* flags the value comes from
+} field_t;
+
+static void get_pci(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%04x:%02x:%02x.%x", d->pcidomain, d->pcibus, d->pcidev, d->pcifunc);
+}
+
+static void get_vendor_id(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "0x%04x", d->vendor_id);
+}
+
+static void get_device_id(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "0x%04x", d->device_id);
+}
+
+static void get_revision(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "0x%02x", d->pcirev);
+}
+
+static void get_subvendor(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "0x%04x", d->subvendor);
+}
+
+static void get_subdevice(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "0x%04x", d->subdevice);
+}
+
+static void get_subsystem(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", d->subsystem ? d->subsystem : "");
+}
+
+static void get_name(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", d->gpu ? d->gpu->name : "");
+}
+
+static void get_asic(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", asic_name(d->gpu ? d->gpu->asic_type : CHIP_UNKNOWN));
+}
+
+static void get_bios_version(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", d->bios_version);
+}
+
+static void get_memconfig(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "0x%x", d->memconfig);
+}
+
+static void get_mem_type(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", mem_type_name(d->mem ? d->mem->type : d->mem_type));
+}
+
+static void get_mem_vendor(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", mem_vendor_name(d->mem_manufacturer));
+}
+
+static void get_mem_manufacturer(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%d", d->mem_manufacturer);
+}
+
+static void get_mem_model(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%d", d->mem_model);
+}
+
+static void get_mem_name(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", d->mem ? d->mem->name : "");
+}
+
+static void get_rom_hash(const gpu_t *d, char *buf, size_t len)
+{
+	if (d->fp.valid)
+		snprintf(buf, len, "%016llx", (unsigned long long)d->fp.rom_hash);
+	else
+		snprintf(buf, len, "%s", "");
+}
+
+static void get_timing_hash(const gpu_t *d, char *buf, size_t len)
+{
+	if (d->fp.valid)
+		snprintf(buf, len, "%016llx", (unsigned long long)d->fp.timing_hash);
+	else
+		snprintf(buf, len, "%s", "");
+}
+
+static void get_rom_status(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", fingerprint_status_name(d->rom_status));
+}
+
+static void get_timed_out(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", d->timed_out ? "true" : "false");
+}
+
+static void get_path(const gpu_t *d, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", d->path ? d->path : "");
+}
+
+static const field_t fields[] = {
+	{ "pci", FIELD_STRING, get_pci, 0 },
+	{ "vendor_id", FIELD_STRING, get_vendor_id, 0 },
+	{ "device_id", FIELD_STRING, get_device_id, 0 },
+	{ "revision", FIELD_STRING, get_revision, 0 },
+	{ "subvendor", FIELD_STRING, get_subvendor, 0 },
+	{ "subdevice", FIELD_STRING, get_subdevice, 0 },
+	{ "subsystem", FIELD_STRING, get_subsystem, AMDGPUINFO_PROBE_NAMES },
+	{ "name", FIELD_STRING, get_name, 0 },
+	{ "asic", FIELD_STRING, get_asic, 0 },
+	{ "bios_version", FIELD_STRING, get_bios_version, AMDGPUINFO_PROBE_VBIOS },
+	{ "memconfig", FIELD_STRING, get_memconfig, AMDGPUINFO_PROBE_MEMORY },
+	{ "mem_type", FIELD_STRING, get_mem_type, AMDGPUINFO_PROBE_MEMORY },
+	{ "mem_vendor", FIELD_STRING, get_mem_vendor, AMDGPUINFO_PROBE_MEMORY },
+	{ "mem_manufacturer", FIELD_NUMBER, get_mem_manufacturer, AMDGPUINFO_PROBE_MEMORY },
+	{ "mem_model", FIELD_NUMBER, get_mem_model, AMDGPUINFO_PROBE_MEMORY },
+	{ "mem_name", FIELD_STRING, get_mem_name, AMDGPUINFO_PROBE_MEMORY },
+	{ "sysfs_path", FIELD_STRING, get_path, 0 },
+	{ "rom_hash", FIELD_STRING, get_rom_hash, AMDGPUINFO_PROBE_VBIOS },
+	{ "timing_hash", FIELD_STRING, get_timing_hash, AMDGPUINFO_PROBE_VBIOS },
+	{ "rom_status", FIELD_STRING, get_rom_status, AMDGPUINFO_PROBE_VBIOS },
+	{ "timed_out", FIELD_BOOLEAN, get_timed_out, 0 },
+};
+
+#define NUM_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+_Static_assert(NUM_FIELDS <= OUTPUT_MAX_FIELDS, "OUTPUT_MAX_FIELDS is too small");
+
+bool output_parse_fields(const char *list, output_fields_t *sel)
+{
+	const char *end;
+	size_t i, len;
+
+	sel->count = 0;
+
+	for (; *list; list = *end ? end + 1 : end)
+	{
+		end = list + strcspn(list, ",");
+		len = (size_t)(end - list);
+
+		for (i = 0; i < NUM_FIELDS; ++i) {
+			if (strlen(fields[i].name) == len && !strncasecmp(fields[i].name, list, len))
+				break;
+		}
+
+		if (i == NUM_FIELDS || sel->count == OUTPUT_MAX_FIELDS)
+			return false;
+
+		sel->index[sel->count++] = (unsigned char)i;
+	}
+
+	return sel->count > 0;
+}
+
+const char *output_field_name(size_t index)
+{
+	return index < NUM_FIELDS ? fields[index].name : NULL;
+}
+
+// the probe plan: what the library has to find out for this output
+unsigned int output_probes(output_format_t format, const output_fields_t *sel)
+{
+	unsigned int probes = 0;
+	size_t i;
+
+	if (sel != NULL) {
+		for (i = 0; i < sel->count; ++i)
+			probes |= fields[sel->index[i]].probes;
+		return probes;
+	}
+
+	switch (format) {
+	case OUTPUT_BIOS:
+		return AMDGPUINFO_PROBE_VBIOS;
+	case OUTPUT_SHORT:
+	case OUTPUT_PROMETHEUS:
+		return AMDGPUINFO_PROBE_VBIOS | AMDGPUINFO_PROBE_MEMORY;
+	default:
+		return AMDGPUINFO_PROBE_ALL;
+	}
+}
+
+// the whole table, or the fields picked with --fields
+static size_t field_count(const output_t *out)
+{
+	return out->fields ? out->fields->count : NUM_FIELDS;
+}
+
+static const field_t *field_at(const output_t *out, size_t i)
+{
+	return &fields[out->fields ? out->fields->index[i] : i];
+}
+
+/***********************************************
+ * Text formats
+ ***********************************************/
+static const char *bios_version(const gpu_t *d)
+{
+	//if bios version is blank, replace it with BLANK_BIOS_VER
+	return d->bios_version[0] ? d->bios_version : BLANK_BIOS_VER;
+}
+
+static void text_device(outbuf_t *out, const gpu_t *d)
+{
+	if (d->gpu) {
+		outbuf_printf(out,
+			"-----------------------------------\n"
+			"Found Card: %04x:%04x rev %02x (AMD %s)\n"
+			"Chip Type: %s\n"
+			"BIOS Version: %s\n"
+			"PCI: %02x:%02x.%x\n"
+			"Subvendor:  0x%04x\n"
+			"Subdevice:  0x%04x\n"
+			"Subsystem: %s\n"
+			"Sysfs Path: %s\n",
+			AMD_PCI_VENDOR_ID, d->gpu->device_id, d->pcirev, d->gpu->name,
+			asic_name(d->gpu->asic_type), bios_version(d),
+			d->pcibus, d->pcidev, d->pcifunc,
+			d->subvendor, d->subdevice, d->subsystem ? d->subsystem : "",
+			d->path);
+
+		if (d->fp.valid)
+			outbuf_printf(out, "VBIOS Hash: %016llx (%s)\n", (unsigned long long)d->fp.rom_hash,
+				      fingerprint_status_name(d->rom_status));
+
+		if (d->timed_out)
+			outbuf_puts(out, "Probe: timed out, results are partial\n");
+
+		outbuf_printf(out, "Memory Configuration: 0x%x\n", d->memconfig);
+
+		outbuf_puts(out, "Memory Model: ");
+
+		if (d->mem && d->mem->manufacturer != 0) {
+			outbuf_printf(out, "%s:%s:\n", d->mem->name, mem_type_name(d->mem->type));
+		} else {
+			outbuf_printf(out, "Unknown Memory - Mfr:%d Model:%d\n", d->mem_manufacturer, d->mem_model);
+		}
+	}
+	else {
+		outbuf_printf(out,
+			"-----------------------------------\n"
+			"Unknown card: %04x:%04x rev %02x\n"
+			"PCI: %02x:%02x.%x\n"
+			"Subvendor:  0x%04x\n"
+			"Subdevice:  0x%04x\n",
+			d->vendor_id, d->device_id, d->pcirev,
+			d->pcibus, d->pcidev, d->pcifunc,
+			d->subvendor, d->subdevice);
+	}
+}
+
+static void short_device(outbuf_t *out, const gpu_t *d)
+{
+	outbuf_printf(out, "GPU:%02x.%02x.%x:", d->pcibus, d->pcidev, d->pcifunc);
+
+	if (d->gpu) {
+		outbuf_printf(out, "%s:", d->gpu->name);
+	} else {
+		outbuf_printf(out, "Unknown GPU %04x-%04xr%02x:", d->vendor_id, d->device_id, d->pcirev);
+	}
+
+	outbuf_printf(out, "%s:0x%x:", bios_version(d), d->memconfig);
+
+	if (d->mem && d->mem->manufacturer != 0) {
+		outbuf_printf(out, "%s:%s:", d->mem->name, mem_type_name(d->mem->type));
+	} else {
+		outbuf_printf(out, "Unknown Memory %d-%d:%s:", d->mem_manufacturer, d->mem_model, mem_type_name(MEM_UNKNOWN));
+	}
+
+	outbuf_printf(out, "%s\n", asic_name(d->gpu ? d->gpu->asic_type : CHIP_UNKNOWN));
+}
+
+static void bios_device(outbuf_t *out, const gpu_t *d)
+{
+	outbuf_printf(out, "GPU:%s\n", bios_version(d));
+}
+
+// --fields with a text format: the short form, with the chosen fields
+static void fields_device(output_t *out, const gpu_t *d)
+{
+	char value[256];
+	size_t i;
+
+	outbuf_printf(&out->buf, "GPU:%02x.%02x.%x", d->pcibus, d->pcidev, d->pcifunc);
+
+	for (i = 0; i < field_count(out); ++i)
+	{
+		field_at(out, i)->get(d, value, sizeof(value));
+		outbuf_printf(&out->buf, ":%s", value);
+	}
+
+	outbuf_puts(&out->buf, "\n");
+}
+
+/***********************************************
+ * JSON
+ ***********************************************/
+void outbuf_json_string(outbuf_t *out, const char *s)
+{
+	const char *run = s;
+
+	outbuf_puts(out, "\"");
+
+	for (; *s; ++s)
+	{
+		unsigned char c = (unsigned char)*s;
+
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		outbuf_write(out, run, (size_t)(s - run));
+		run = s + 1;
+
+		switch (c) {
+		case '"':  outbuf_puts(out, "\\\""); break;
+		case '\\': outbuf_puts(out, "\\\\"); break;
+		case '\n': outbuf_puts(out, "\\n"); break;
+		case '\t': outbuf_puts(out, "\\t"); break;
+		default:   outbuf_printf(out, "\\u%04x", c); break;
+		}
+	}
+
+	outbuf_write(out, run, (size_t)(s - run));
+	outbuf_puts(out, "\"");
+}
+
+static void json_begin(outbuf_t *out)
+{
+	outbuf_puts(out, "[");
+}
+
+static void json_device(output_t *out, const gpu_t *d)
+{
+	const field_t *f;
+	char value[256];
+	size_t i;
+
+	outbuf_puts(&out->buf, out->count ? ",\n  {" : "\n  {");
+
+	for (i = 0; i < field_count(out); ++i)
+	{
+		f = field_at(out, i);
+		f->get(d, value, sizeof(value));
+
+		outbuf_printf(&out->buf, "%s\"%s\": ", i ? ", " : "", f->name);
+		if (f->type != FIELD_STRING) {
+			outbuf_puts(&out->buf, value);
+		} else {
+			outbuf_json_string(&out->buf, value);
+		}
+	}
+
+	outbuf_puts(&out->buf, "}");
+}
+
+static void json_end(outbuf_t *out, size_t count)
+{
+	outbuf_puts(out, count ? "\n]\n" : "]\n");
+}
+
+/***********************************************
+ * CSV (RFC 4180)
+ ***********************************************/
+void outbuf_csv_string(outbuf_t *out, const char *s)
+{
+	const char *q;
+
+	if (strpbrk(s, ",\"\r\n") == NULL) {
+		outbuf_puts(out, s);
+		return;
+	}
+
+	outbuf_puts(out, "\"");
+	while ((q = strchr(s, '"')) != NULL)
+	{
+		outbuf_write(out, s, (size_t)(q - s + 1));
+		outbuf_puts(out, "\"");
+		s = q + 1;
+	}
+	outbuf_puts(out, s);
+	outbuf_puts(out, "\"");
+}
+
+static void csv_begin(output_t *out)
+{
+	size_t i;
+
+	for (i = 0; i < field_count(out); ++i)
+		outbuf_printf(&out->buf, "%s%s", i ? "," : "", field_at(out, i)->name);
+
+	outbuf_puts(&out->buf, "\n");
+}
+
+static void csv_device(output_t *out, const gpu_t *d)
+{
+	char value[256];
+	size_t i;
+
+	for (i = 0; i < field_count(out); ++i)
+	{
+		field_at(out, i)->get(d, value, sizeof(value));
+
+		if (i)
+			outbuf_puts(&out->buf, ",");
+		outbuf_csv_string(&out->buf, value);
+	}
+
+	outbuf_puts(&out->buf, "\n");
+}
+
+/***********************************************
+ * Prometheus text exposition format
+ ***********************************************/
+static void prom_label(outbuf_t *out, const char *name, const char *s, bool first)
+{
+	outbuf_printf(out, "%s%s=\"", first ? "" : ",", name);
+
+	for (; *s; ++s)
+	{
+		switch (*s) {
+		case '"':  outbuf_puts(out, "\\\""); break;
+		case '\\': outbuf_puts(out, "\\\\"); break;
+		case '\n': outbuf_puts(out, "\\n"); break;
+		default:   outbuf_write(out, s, 1); break;
+		}
+	}
+
+	outbuf_puts(out, "\"");
+}
+
+static void prom_begin(outbuf_t *out, outbuf_t *extra)
+{
+	outbuf_puts(out,
+		"# HELP amdgpuinfo_gpu_info AMD GPU inventory, one series per card.\n"
+		"# TYPE amdgpuinfo_gpu_info gauge\n");
+	outbuf_puts(extra,
+		"# HELP amdgpuinfo_gpu_memconfig Raw memory configuration register.\n"
+		"# TYPE amdgpuinfo_gpu_memconfig gauge\n");
+}
+
+static void prom_device(outbuf_t *out, outbuf_t *extra, const gpu_t *d)
+{
+	char pci[32], value[256];
+
+	get_pci(d, pci, sizeof(pci));
+
+	outbuf_puts(out, "amdgpuinfo_gpu_info{");
+	prom_label(out, "pci", pci, true);
+	get_device_id(d, value, sizeof(value));
+	prom_label(out, "device_id", value, false);
+	get_revision(d, value, sizeof(value));
+	prom_label(out, "revision", value, false);
+	get_name(d, value, sizeof(value));
+	prom_label(out, "name", value, false);
+	prom_label(out, "amd_asic_name", asic_name(d->gpu ? d->gpu->asic_type : CHIP_UNKNOWN), false);
+	prom_label(out, "bios_version", d->bios_version, false);
+	get_mem_type(d, value, sizeof(value));
+	prom_label(out, "mem_type", value, false);
+	prom_label(out, "mem_vendor", mem_vendor_name(d->mem_manufacturer), false);
+	get_mem_name(d, value, sizeof(value));
+	prom_label(out, "mem_model", value, false);
+	get_memconfig(d, value, sizeof(value));
+	prom_label(out, "memconfig", value, false);
+	get_rom_hash(d, value, sizeof(value));
+	prom_label(out, "rom_hash", value, false);
+	prom_label(out, "rom_status", fingerprint_status_name(d->rom_status), false);
+	outbuf_puts(out, "} 1\n");
+
+	outbuf_puts(extra, "amdgpuinfo_gpu_memconfig{");
+	prom_label(extra, "pci", pci, true);
+	outbuf_printf(extra, "} %u\n", (unsigned int)d->memconfig);
+}
+
+static void prom_end(outbuf_t *out, outbuf_t *extra, size_t count)
+{
+	outbuf_write(out, extra->data ? extra->data : "", extra->len);
+	outbuf_printf(out,
+		"# HELP amdgpuinfo_gpus Number of AMD GPUs found.\n"
+		"# TYPE amdgpuinfo_gpus gauge\n"
+		"amdgpuinfo_gpus %zu\n", count);
+}
+
+// temporary file next to path, so the final rename stays on one filesystem
+int output_open_atomic(const char *path, char *tmp, size_t len)
+{
+	snprintf(tmp, len, "%s.%d.tmp", path, (int)getpid());
+
+	return open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+// readers see either the old file or the complete new one
+bool output_commit_atomic(int fd, const char *tmp, const char *path)
+{
+	bool ok = fsync(fd) == 0;
+
+	ok = (close(fd) == 0) && ok;
+
+	if (!ok || rename(tmp, path) < 0) {
+		unlink(tmp);
+		return false;
+	}
+
+	return true;
+}
+
+/***********************************************
+ * Timings
+ ***********************************************/
+static double ms(uint64_t ns)
+{
+	return (double)ns / 1e6;
+}
+
+static void timings_table(outbuf_t *out, const uint64_t *run, const gpu_t *list)
+{
+	char pci[16];
+	const gpu_t *d;
+	int i;
+
+	outbuf_puts(out, "\nTimings (ms)\n");
+	for (i = 0; i < TIME_RUN_PHASES; ++i)
+		outbuf_printf(out, "%-12s %10.3f\n", timing_run_names[i], ms(run[i]));
+
+	outbuf_printf(out, "\n%-12s", "device");
+	for (i = 0; i < TIME_DEVICE_PHASES; ++i)
+		outbuf_printf(out, " %10s", timing_device_names[i]);
+	outbuf_puts(out, "\n");
+
+	for (d = list; d; d = d->next)
+	{
+		get_pci(d, pci, sizeof(pci));
+		outbuf_printf(out, "%-12s", pci);
+		for (i = 0; i < TIME_DEVICE_PHASES; ++i)
+			outbuf_printf(out, " %10.3f", ms(d->time[i]));
+		outbuf_puts(out, d->cached ? " (cached)\n" : "\n");
+	}
+}
+
+static void timings_json(outbuf_t *out, const uint64_t *run, const gpu_t *list)
+{
+	char pci[16];
+	const gpu_t *d;
+	int i;
+
+	outbuf_puts(out, "{\"run\": {");
+	for (i = 0; i < TIME_RUN_PHASES; ++i)
+		outbuf_printf(out, "%s\"%s_ns\": %llu", i ? ", " : "", timing_run_names[i], (unsigned long long)run[i]);
+	outbuf_puts(out, "}, \"devices\": [");
+
+	for (d = list; d; d = d->next)
+	{
+		get_pci(d, pci, sizeof(pci));
+		outbuf_printf(out, "%s\n  {\"pci\": \"%s\", \"cached\": %s", d == list ? "" : ",", pci, d->cached ? "true" : "false");
+		for (i = 0; i < TIME_DEVICE_PHASES; ++i)
+			outbuf_printf(out, ", \"%s_ns\": %llu", timing_device_names[i], (unsigned long long)d->time[i]);
+		outbuf_puts(out, "}");
+	}
+
+	outbuf_puts(out, list ? "\n]}\n" : "]}\n");
+}
+
+// long format, so run and device phases fit the same three columns
+static void timings_csv(outbuf_t *out, const uint64_t *run, const gpu_t *list)
+{
+	char pci[16];
+	const gpu_t *d;
+	int i;
+
+	outbuf_puts(out, "scope,phase,ns\n");
+	for (i = 0; i < TIME_RUN_PHASES; ++i)
+		outbuf_printf(out, "run,%s,%llu\n", timing_run_names[i], (unsigned long long)run[i]);
+
+	for (d = list; d; d = d->next)
+	{
+		get_pci(d, pci, sizeof(pci));
+		for (i = 0; i < TIME_DEVICE_PHASES; ++i)
+			outbuf_printf(out, "%s,%s,%llu\n", pci, timing_device_names[i], (unsigned long long)d->time[i]);
+	}
+}
+
+// machine readable formats get machine readable timings, anything else a table
+bool output_timings(int fd, output_format_t format, const uint64_t *run, const gpu_t *list)
+{
+	outbuf_t out;
+	bool ok;
+
+	outbuf_init(&out, fd);
+
+	if (format == OUTPUT_JSON)
+		timings_json(&out, run, list);
+	else if (format == OUTPUT_CSV)
+		timings_csv(&out, run, list);
+	else
+		timings_table(&out, run, list);
+
+	ok = outbuf_flush(&out);
+	outbuf_free(&out);
+
+	return ok;
+}
+
+/***********************************************
+ * Backend dispatch
+ ***********************************************/
+static const char *format_names[] = {
+	[OUTPUT_TEXT] = "text",
+	[OUTPUT_SHORT] = "short",
+	[OUTPUT_BIOS] = "bios",
+	[OUTPUT_JSON] = "json",
+	[OUTPUT_CSV] = "csv",
+	[OUTPUT_PROMETHEUS] = "prometheus",
+};
+
+bool output_parse_format(const char *name, output_format_t *format)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(format_names) / sizeof(format_names[0]); ++i)
+	{
+		if (!strcasecmp(name, format_names[i])) {
+			*format = (output_format_t)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// human readable formats, anything else must keep stdout clean
+bool output_is_text(output_format_t format)
+{
+	return format == OUTPUT_TEXT || format == OUTPUT_SHORT || format == OUTPUT_BIOS;
+}
+
+void output_begin(output_t *out, output_format_t format, const output_fields_t *fields, int fd)
+{
+	out->format = format;
+	out->fields = fields;
+	out->count = 0;
+	outbuf_init(&out->buf, fd);
+	outbuf_init(&out->extra, fd);
+
+	// anything printed through stdio so far has to come first
+	fflush(stdout);
+
+	switch (format) {
+	case OUTPUT_JSON:
+		json_begin(&out->buf);
+		break;
+	case OUTPUT_CSV:
+		csv_begin(out);
+		break;
+	case OUTPUT_PROMETHEUS:
+		prom_begin(&out->buf, &out->extra);
+		break;
+	default:
+		break;
+	}
+}
+
+void output_device(output_t *out, const gpu_t *d)
+{
+	switch (out->fields && output_is_text(out->format) ? OUTPUT_SHORT : out->format) {
+	case OUTPUT_TEXT:
+		text_device(&out->buf, d);
+		break;
+	case OUTPUT_SHORT:
+		if (out->fields)
+			fields_device(out, d);
+		else
+			short_device(&out->buf, d);
+		break;
+	case OUTPUT_BIOS:
+		bios_device(&out->buf, d);
+		break;
+	case OUTPUT_JSON:
+		json_device(out, d);
+		break;
+	case OUTPUT_CSV:
+		csv_device(out, d);
+		break;
+	case OUTPUT_PROMETHEUS:
+		prom_device(&out->buf, &out->extra, d);
+		break;
+	}
+
+	++out->count;
+
+	// metric families must stay together, so that one goes out at the end
+	if (out->format != OUTPUT_PROMETHEUS)
+		outbuf_flush(&out->buf);
+}
+
+bool output_end(output_t *out)
+{
+	bool ok;
+
+	if (out->format == OUTPUT_JSON)
+		json_end(&out->buf, out->count);
+	else if (out->format == OUTPUT_PROMETHEUS)
+		prom_end(&out->buf, &out->extra, out->count);
+
+	ok = outbuf_flush(&out->buf);
+	outbuf_free(&out->buf);
+	outbuf_free(&out->extra);
+
+	return ok;
+}
@@ -0,0 +1,87 @@
+/*
+ * AMDGPUInfo - output backends
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "amdgpuinfo.h"
+#include "gpu.h"
+#include "timing.h"
+
+#define BLANK_BIOS_VER "xxx-xxx-xxxx"
+
+/*
+ * Growable buffer a whole record is assembled in before it goes out
+ * with a single write(2). It is reused from one record to the next.
+ */
+typedef struct {
+	char *data;
+	size_t len, alloc;
+	int fd;
+	bool failed;
+} outbuf_t;
+
+void outbuf_init(outbuf_t *out, int fd);
+void outbuf_free(outbuf_t *out);
+void outbuf_write(outbuf_t *out, const char *data, size_t len);
+void outbuf_puts(outbuf_t *out, const char *str);
+void outbuf_printf(outbuf_t *out, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+bool outbuf_flush(outbuf_t *out);
+
+// quoted and escaped as needed for the format
+void outbuf_json_string(outbuf_t *out, const char *s);
+void outbuf_csv_string(outbuf_t *out, const char *s);
+
+typedef enum {
+	OUTPUT_TEXT = 0,	// long form
+	OUTPUT_SHORT,		// --short
+	OUTPUT_BIOS,		// --biosonly
+	OUTPUT_JSON,
+	OUTPUT_CSV,
+	OUTPUT_PROMETHEUS,	// node_exporter textfile collector
+} output_format_t;
+
+#define OUTPUT_MAX_FIELDS 32
+
+// --fields, indexes into the field table in the order asked for
+typedef struct {
+	unsigned char index[OUTPUT_MAX_FIELDS];
+	size_t count;
+} output_fields_t;
+
+typedef struct {
+	output_format_t format;
+	const output_fields_t *fields; // NULL for all of them
+	outbuf_t buf;
+	outbuf_t extra; // metric families emitted after all devices
+	size_t count;
+} output_t;
+
+bool output_parse_format(const char *name, output_format_t *format);
+bool output_is_text(output_format_t format);
+
+// comma separated field names, false if one is unknown
+bool output_parse_fields(const char *list, output_fields_t *sel);
+const char *output_field_name(size_t index); // NULL past the last one
+
+// AMDGPUINFO_PROBE_* flags the format, or the selected fields, need
+unsigned int output_probes(output_format_t format, const output_fields_t *sel);
+
+void output_begin(output_t *out, output_format_t format, const output_fields_t *fields, int fd);
+void output_device(output_t *out, const gpu_t *gpu);
+bool output_end(output_t *out);
+
+bool output_timings(int fd, output_format_t format, const uint64_t *run, const gpu_t *list);
+
+int output_open_atomic(const char *path, char *tmp, size_t len);
+bool output_commit_atomic(int fd, const char *tmp, const char *path);
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * AMDGPUInfo - bounded worker pool
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+typedef struct {
+	pthread_mutex_t lock;
+	size_t next, count;
+	unsigned int workers;
+	pool_fn_t fn;
+	void *arg;
+} pool_t;
+
+// number of workers used when the user did not ask for a specific count
+unsigned int pool_default_jobs(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (n > 0) ? (unsigned int)n : 1;
+}
+
+// number of threads pool_run() will use for count items
+unsigned int pool_workers(unsigned int jobs, size_t count)
+{
+	if (jobs == 0)
+		jobs = pool_default_jobs();
+
+	if (jobs > count)
+		jobs = (unsigned int)count;
+
+	return jobs ? jobs : 1;
+}
+
+// hand out indexes one at a time until the work runs out
+static void *pool_worker(void *data)
+{
+	pool_t *pool = data;
+	unsigned int worker;
+	size_t i;
+
+	pthread_mutex_lock(&pool->lock);
+	worker = pool->workers++;
+	pthread_mutex_unlock(&pool->lock);
+
+	for (;;)
+	{
+		pthread_mutex_lock(&pool->lock);
+		i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (i >= pool->count)
+			break;
+
+		pool->fn(pool->arg, i, worker);
+	}
+
+	return NULL;
+}
+
+/*
+ * Run fn over count items with at most jobs threads.
+ * The calling thread takes part in the work, so jobs == 1 never spawns.
+ */
+int pool_run(unsigned int jobs, size_t count, pool_fn_t fn, void *arg)
+{
+	pool_t pool = { .next = 0, .count = count, .workers = 0, .fn = fn, .arg = arg };
+	pthread_t *threads = NULL;
+	unsigned int i, started = 0;
+
+	jobs = pool_workers(jobs, count);
+
+	pthread_mutex_init(&pool.lock, NULL);
+
+	if (jobs > 1 && (threads = malloc(sizeof(pthread_t) * (jobs - 1))) != NULL) {
+		for (i = 0; i < jobs - 1; ++i) {
+			if (pthread_create(&threads[i], NULL, pool_worker, &pool) != 0)
+				break;
+			++started;
+		}
+	}
+
+	pool_worker(&pool);
+
+	for (i = 0; i < started; ++i)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	pthread_mutex_destroy(&pool.lock);
+
+	return 0;
+}
@@ -0,0 +1,22 @@
+/*
+ * AMDGPUInfo - bounded worker pool
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/*
+ * Called once for every index in [0, count). worker is in
+ * [0, pool_workers()) and identifies the thread running the call.
+ */
+typedef void (*pool_fn_t)(void *arg, size_t index, unsigned int worker);
+
+unsigned int pool_default_jobs(void);
+unsigned int pool_workers(unsigned int jobs, size_t count);
+int pool_run(unsigned int jobs, size_t count, pool_fn_t fn, void *arg);
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * AMDGPUInfo - per-ASIC register map
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "regs.h"
+
+/*
+ * One line per ASIC that differs from the default at the end.
+ * Vega and newer moved the MC behind the UMC/DF and have no
+ * MC_SEQ_MISC0, their memory comes from the VBIOS.
+ */
+static const asic_regs_t asic_reg_table[] = {
+	{ CHIP_FIJI,	{ [REG_MC_SEQ_MISC0] = 0xa71 } },
+	{ CHIP_VEGA10,	{ [REG_MC_SEQ_MISC0] = REG_ABSENT } },
+	{ CHIP_VEGA20,	{ [REG_MC_SEQ_MISC0] = REG_ABSENT } },
+
+	// everything else, terminates the table
+	{ CHIP_UNKNOWN,	{ [REG_MC_SEQ_MISC0] = 0xa80 } },
+};
+
+const asic_regs_t *asic_regs(unsigned int asic_type)
+{
+	const asic_regs_t *r;
+
+	for (r = asic_reg_table; r->asic_type != CHIP_UNKNOWN; ++r)
+	{
+		if (r->asic_type == asic_type)
+			break;
+	}
+
+	return r;
+}
+
+bool asic_has_reg(const asic_regs_t *regs, unsigned int reg)
+{
+	return reg < REG_COUNT && regs->offset[reg] != REG_ABSENT;
+}
+
+bool regs_read(hwio_t *hw, const gpu_t *d, int bar, const asic_regs_t *regs,
+	       uint32_t vals[REG_COUNT])
+{
+	unsigned int offsets[REG_COUNT], reg;
+	uint32_t read[REG_COUNT];
+	char path[1100];
+	size_t n = 0, i;
+	off_t base;
+
+	memset(vals, 0, sizeof(uint32_t) * REG_COUNT);
+
+	for (reg = 0; reg < REG_COUNT; ++reg)
+	{
+		if (asic_has_reg(regs, reg))
+			offsets[n++] = regs->offset[reg];
+	}
+
+	if (n == 0)
+		return true;
+
+	// resourceN maps the BAR itself, /dev/mem needs its bus address
+	snprintf(path, sizeof(path), "%s/resource%d", d->path ? d->path : "", bar);
+	if (d->path == NULL || !hwio_mmio_read(hw, path, 0, (size_t)d->size[bar], offsets, read, n)) {
+		base = (off_t)(d->base_addr[bar] & 0xfffffff0);
+		if (!hwio_mmio_read(hw, "/dev/mem", base, (size_t)d->size[bar], offsets, read, n))
+			return false;
+	}
+
+	for (reg = 0, i = 0; reg < REG_COUNT; ++reg)
+	{
+		if (asic_has_reg(regs, reg))
+			vals[reg] = read[i++];
+	}
+
+	return true;
+}
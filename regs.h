@@ -0,0 +1,44 @@
+/*
+ * AMDGPUInfo - per-ASIC register map
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef REGS_H
+#define REGS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gpu.h"
+#include "hwio.h"
+
+// size of the BAR holding the MMIO registers
+#define REGS_BAR_SIZE 0x40000
+
+// registers amdgpuinfo knows how to use
+enum {
+	REG_MC_SEQ_MISC0 = 0,	// memory configuration, 0xTXXXMVXX
+	REG_BIOS_SCRATCH_4,	// memory strap in bits 23:16, where FirmwareInfo says, never in the table
+	REG_COUNT
+};
+
+// dword offset meaning "this ASIC does not have it"
+#define REG_ABSENT 0
+
+typedef struct {
+	unsigned int asic_type;
+	unsigned int offset[REG_COUNT];	// dword index into the register BAR
+} asic_regs_t;
+
+const asic_regs_t *asic_regs(unsigned int asic_type);
+bool asic_has_reg(const asic_regs_t *regs, unsigned int reg);
+
+/*
+ * Read every register the ASIC has from the register BAR at index bar,
+ * through one mapping. Absent registers read as 0.
+ */
+bool regs_read(hwio_t *hw, const gpu_t *d, int bar, const asic_regs_t *regs,
+	       uint32_t vals[REG_COUNT]);
+
+#endif
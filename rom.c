@@ -0,0 +1,390 @@
+/*
+ * AMDGPUInfo - VBIOS image access
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hwio.h"
+#include "rom.h"
+#include "timing.h"
+
+// pread() granularity, big enough to get a legacy image in one call
+#define ROM_CHUNK 0x10000
+
+#define ROM_SIGNATURE 0xaa55
+#define ROM_LEGACY_LENGTH 0x02
+#define ROM_PCIR_OFFSET 0x18
+#define PCIR_SIGNATURE 0x52494350 // "PCIR"
+#define PCIR_IMAGE_LENGTH 0x10
+#define PCIR_INDICATOR 0x15
+#define PCIR_LAST_IMAGE 0x80
+
+#define ROM_VERSION_OFFSET 0x6e
+
+void rom_init(rom_t *rom)
+{
+	memset(rom, 0, sizeof(*rom));
+}
+
+// forget the current image but keep the buffer for the next read
+void rom_release(rom_t *rom)
+{
+	if (rom->map != NULL) {
+		munmap(rom->map, rom->map_size);
+		rom->map = NULL;
+		rom->map_size = 0;
+	}
+
+	rom->data = NULL;
+	rom->size = rom->expected = 0;
+	rom->relock_failed = false;
+	rom->unlock_ns = rom->read_ns = rom->relock_ns = 0;
+}
+
+void rom_free(rom_t *rom)
+{
+	rom_release(rom);
+	free(rom->buf);
+	rom_init(rom);
+}
+
+/***********************************************
+ * Bounds checked accessors
+ ***********************************************/
+bool rom_u8(const rom_t *rom, size_t offset, uint8_t *val)
+{
+	if (offset >= rom->size)
+		return false;
+
+	*val = rom->data[offset];
+	return true;
+}
+
+bool rom_u16(const rom_t *rom, size_t offset, uint16_t *val)
+{
+	if (rom->size < 2 || offset > rom->size - 2)
+		return false;
+
+	*val = rom->data[offset] | (rom->data[offset + 1] << 8);
+	return true;
+}
+
+bool rom_u32(const rom_t *rom, size_t offset, uint32_t *val)
+{
+	if (rom->size < 4 || offset > rom->size - 4)
+		return false;
+
+	*val = (uint32_t)rom->data[offset] |
+	       ((uint32_t)rom->data[offset + 1] << 8) |
+	       ((uint32_t)rom->data[offset + 2] << 16) |
+	       ((uint32_t)rom->data[offset + 3] << 24);
+	return true;
+}
+
+// copy a NUL terminated string out of the image, truncated to len - 1
+size_t rom_string(const rom_t *rom, size_t offset, char *buf, size_t len)
+{
+	size_t n = 0;
+
+	if (len == 0)
+		return 0;
+
+	while (offset + n < rom->size && n < len - 1 && rom->data[offset + n] != 0)
+	{
+		buf[n] = (char)rom->data[offset + n];
+		++n;
+	}
+	buf[n] = 0;
+
+	return n;
+}
+
+/***********************************************
+ * Reading
+ ***********************************************/
+
+// make sure the first want bytes of the file are in the buffer
+static int rom_fill(rom_t *rom, hwio_t *hw, const char *path, size_t want, size_t limit)
+{
+	unsigned char *buf;
+	size_t alloc;
+	ssize_t n;
+
+	// a mapped image is already complete
+	if (rom->map != NULL)
+		return ROM_OK;
+
+	if (want > limit)
+		want = limit;
+
+	// read whole chunks, the next header is usually right after this one
+	want = (want + ROM_CHUNK - 1) / ROM_CHUNK * ROM_CHUNK;
+	if (want > limit)
+		want = limit;
+
+	if (want > rom->alloc) {
+		alloc = rom->alloc ? rom->alloc : ROM_CHUNK;
+		while (alloc < want)
+			alloc *= 2;
+
+		if ((buf = realloc(rom->buf, alloc)) == NULL)
+			return ROM_ERR_NOMEM;
+
+		rom->buf = buf;
+		rom->alloc = alloc;
+	}
+
+	rom->data = rom->buf;
+
+	while (rom->size < want)
+	{
+		n = hwio_read(hw, path, rom->buf + rom->size, want - rom->size, (off_t)rom->size);
+		if (n < 0)
+			return ROM_ERR_READ;
+		if (n == 0)
+			break;
+		rom->size += (size_t)n;
+	}
+
+	return ROM_OK;
+}
+
+/*
+ * Walk the chain of PCI expansion ROM images to find out how large the
+ * whole thing is. Newer VBIOSes are well over 64k and carry an EFI image
+ * after the legacy one. Returns 0 when the headers can not be followed.
+ */
+static size_t rom_walk_images(rom_t *rom, hwio_t *hw, const char *path, size_t limit)
+{
+	size_t offset = 0;
+	uint16_t sig, pcir, length;
+	uint32_t pcir_sig;
+	uint8_t indicator;
+
+	while (offset < limit)
+	{
+		if (rom_fill(rom, hw, path, offset + ROM_PCIR_OFFSET + 2, limit) != ROM_OK ||
+		    !rom_u16(rom, offset, &sig) || sig != ROM_SIGNATURE ||
+		    !rom_u16(rom, offset + ROM_PCIR_OFFSET, &pcir))
+			break;
+
+		if (rom_fill(rom, hw, path, offset + pcir + PCIR_INDICATOR + 1, limit) != ROM_OK ||
+		    !rom_u32(rom, offset + pcir, &pcir_sig) || pcir_sig != PCIR_SIGNATURE ||
+		    !rom_u16(rom, offset + pcir + PCIR_IMAGE_LENGTH, &length) ||
+		    !rom_u8(rom, offset + pcir + PCIR_INDICATOR, &indicator) ||
+		    length == 0)
+			break;
+
+		offset += (size_t)length * 512;
+
+		if (indicator & PCIR_LAST_IMAGE)
+			break;
+	}
+
+	// no PCI data structure, fall back to the legacy length byte
+	if (offset == 0 && rom_u8(rom, ROM_LEGACY_LENGTH, &indicator))
+		offset = (size_t)indicator * 512;
+
+	// may be past limit, which makes the read short
+	return offset < ROM_MAX_SIZE ? offset : ROM_MAX_SIZE;
+}
+
+// validate the start of the image and read the rest of it
+static int rom_finish(rom_t *rom, hwio_t *hw, const char *path, size_t limit)
+{
+	uint16_t sig;
+	int ret;
+
+	if (!rom_u16(rom, 0, &sig) || sig != ROM_SIGNATURE)
+		return ROM_ERR_INVALID;
+
+	rom->expected = rom_walk_images(rom, hw, path, limit);
+
+	if ((ret = rom_fill(rom, hw, path, rom->expected, limit)) != ROM_OK)
+		return ret;
+
+	if (rom->size < rom->expected)
+		return ROM_SHORT;
+
+	// only expose the advertised image, not the padding after it
+	if (rom->expected > 0)
+		rom->size = rom->expected;
+
+	return ROM_OK;
+}
+
+static int rom_read_hw(rom_t *rom, hwio_t *hw, const char *path)
+{
+	size_t limit = ROM_MAX_SIZE;
+	off_t size;
+	int ret;
+
+	rom_release(rom);
+
+	// sysfs reports the ROM BAR size, a dump reports its own size
+	if ((size = hwio_size(hw, path)) < 0)
+		return ROM_ERR_OPEN;
+	if (size > 0 && (size_t)size < limit)
+		limit = (size_t)size;
+
+	if ((ret = rom_fill(rom, hw, path, ROM_CHUNK, limit)) != ROM_OK)
+		return ret;
+
+	return rom_finish(rom, hw, path, limit);
+}
+
+// read or map a VBIOS dump
+int rom_read_file(rom_t *rom, const char *path)
+{
+	struct stat st;
+	size_t limit;
+	int fd;
+
+	rom_release(rom);
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return ROM_ERR_OPEN;
+
+	// plain files can be used in place
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		limit = (size_t)st.st_size < ROM_MAX_SIZE ? (size_t)st.st_size : ROM_MAX_SIZE;
+
+		if ((rom->map = mmap(NULL, limit, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+			close(fd);
+			rom->map_size = limit;
+			rom->data = rom->map;
+			rom->size = limit;
+			return rom_finish(rom, NULL, path, limit);
+		}
+		rom->map = NULL;
+	}
+
+	close(fd);
+
+	return rom_read_hw(rom, hwio_real(), path);
+}
+
+static bool rom_enable(hwio_t *hw, const char *path, bool enable)
+{
+	return hwio_write(hw, path, enable ? "1\n" : "0\n", 2);
+}
+
+/*
+ * Take the advisory lock every amdgpuinfo process holds on the rom
+ * attribute while it probes a device, so one can not relock the ROM
+ * while another is still reading it. Only root can open the attribute,
+ * and only root can read the ROM, so -1 means there is nothing to
+ * serialize with. The lock goes away with rom_unlock_device().
+ */
+int rom_lock_device(hwio_t *hw, const char *devpath)
+{
+	char path[1024];
+	int fd;
+
+	// a trace has no other process to race with
+	if (hw != hwio_real())
+		return -1;
+
+	snprintf(path, sizeof(path), "%s/rom", devpath);
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+
+	while (flock(fd, LOCK_EX) < 0) {
+		if (errno != EINTR) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	return fd;
+}
+
+void rom_unlock_device(int fd)
+{
+	if (fd >= 0)
+		close(fd);
+}
+
+/*
+ * Read the VBIOS of a device through its sysfs rom attribute.
+ * The ROM has to be enabled for reading and is locked again afterwards.
+ */
+int rom_read_device(rom_t *rom, hwio_t *hw, const char *devpath)
+{
+	char path[1024];
+	uint64_t t0, t1, t2;
+	bool unlocked;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/rom", devpath);
+
+	rom_release(rom);
+
+	t0 = timing_now();
+	unlocked = rom_enable(hw, path, true);
+	t1 = timing_now();
+
+	if (!unlocked) {
+		rom->unlock_ns = t1 - t0;
+		return ROM_ERR_UNLOCK;
+	}
+
+	// rom_read_hw() starts with rom_release()
+	ret = rom_read_hw(rom, hw, path);
+	t2 = timing_now();
+
+	if (!rom_enable(hw, path, false))
+		rom->relock_failed = true;
+
+	rom->unlock_ns = t1 - t0;
+	rom->read_ns = t2 - t1;
+	rom->relock_ns = timing_now() - t2;
+
+	return ret;
+}
+
+/*
+ * Disable the ROM of a device whose read never returned. The kernel only
+ * flips a flag, so this goes through even while the read is stuck.
+ */
+bool rom_disable_device(hwio_t *hw, const char *devpath)
+{
+	char path[1024];
+
+	snprintf(path, sizeof(path), "%s/rom", devpath);
+
+	return rom_enable(hw, path, false);
+}
+
+/***********************************************
+ * Parsers
+ ***********************************************/
+
+// the version string pointed to by the legacy ROM header
+bool rom_get_version(const rom_t *rom, char *buf, size_t len)
+{
+	uint16_t sig, ver_offset;
+
+	if (len > 0)
+		buf[0] = 0;
+
+	//check for invalid vbios
+	if (!rom_u16(rom, 0, &sig) || sig != ROM_SIGNATURE)
+		return false;
+
+	if (!rom_u16(rom, ROM_VERSION_OFFSET, &ver_offset))
+		return false;
+
+	return rom_string(rom, ver_offset, buf, len) > 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * AMDGPUInfo - VBIOS image access
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef ROM_H
+#define ROM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hwio.h"
+
+// upper bound for a single VBIOS, well above any PCI option ROM BAR
+#define ROM_MAX_SIZE (16 * 1024 * 1024)
+
+enum {
+	ROM_OK = 0,
+	ROM_SHORT,		// got less than the headers advertise
+	ROM_ERR_UNLOCK,
+	ROM_ERR_OPEN,
+	ROM_ERR_READ,
+	ROM_ERR_NOMEM,
+	ROM_ERR_INVALID,	// no 0xaa55 option ROM signature
+};
+
+/*
+ * A VBIOS image, either read into a buffer that is kept around and
+ * reused by the next read, or mapped straight from a file.
+ */
+typedef struct {
+	const unsigned char *data;
+	size_t size;		// bytes available in data
+	size_t expected;	// bytes the option ROM headers advertise
+	unsigned char *buf;
+	size_t alloc;
+	void *map;
+	size_t map_size;
+	bool relock_failed;
+	uint64_t unlock_ns, read_ns, relock_ns; // rom_read_device() phases
+} rom_t;
+
+void rom_init(rom_t *rom);
+void rom_release(rom_t *rom);
+void rom_free(rom_t *rom);
+
+int rom_read_file(rom_t *rom, const char *path);
+int rom_read_device(rom_t *rom, hwio_t *hw, const char *devpath);
+bool rom_disable_device(hwio_t *hw, const char *devpath);
+int rom_lock_device(hwio_t *hw, const char *devpath);
+void rom_unlock_device(int fd);
+
+bool rom_u8(const rom_t *rom, size_t offset, uint8_t *val);
+bool rom_u16(const rom_t *rom, size_t offset, uint16_t *val);
+bool rom_u32(const rom_t *rom, size_t offset, uint32_t *val);
+size_t rom_string(const rom_t *rom, size_t offset, char *buf, size_t len);
+
+bool rom_get_version(const rom_t *rom, char *buf, size_t len);
+
+#endif
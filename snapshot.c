@@ -0,0 +1,413 @@
+/*
+ * AMDGPUInfo - inventory snapshots
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * A snapshot is a header and one fixed size record per device, in PCI
+ * order. Names are stored as they were resolved, so a diff still reads
+ * right after the tables were updated.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC "AGISNAPS"
+#define SNAPSHOT_VERSION 2
+
+// version 1 entries end before rom_hash
+#define SNAPSHOT_V1_ENTRY 216
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+} snapshot_header_t;
+
+typedef struct {
+	int32_t pcidomain;
+	uint8_t pcibus, pcidev, pcifunc, pcirev;
+	uint16_t vendor_id, device_id;
+	uint32_t subvendor, subdevice;
+	int32_t memconfig;
+	char bios_version[64];
+	char gpu_name[64];
+	char mem_name[64];
+	uint64_t rom_hash; // 0 when unknown
+} snapshot_entry_t;
+
+_Static_assert(offsetof(snapshot_entry_t, rom_hash) == SNAPSHOT_V1_ENTRY, "snapshot entry layout");
+
+typedef struct {
+	const char *name;
+	void (*get)(const snapshot_entry_t *e, char *buf, size_t len); // "" when unknown
+} snapshot_field_t;
+
+static void copy_name(char *dst, const char *src, size_t len)
+{
+	memset(dst, 0, len);
+	if (src != NULL)
+		memcpy(dst, src, strnlen(src, len - 1));
+}
+
+static void entry_from_gpu(snapshot_entry_t *e, const gpu_t *d)
+{
+	memset(e, 0, sizeof(*e));
+	e->pcidomain = d->pcidomain;
+	e->pcibus = d->pcibus;
+	e->pcidev = d->pcidev;
+	e->pcifunc = d->pcifunc;
+	e->pcirev = d->pcirev;
+	e->vendor_id = d->vendor_id;
+	e->device_id = d->device_id;
+	e->subvendor = d->subvendor;
+	e->subdevice = d->subdevice;
+	e->memconfig = d->memconfig;
+	copy_name(e->bios_version, d->bios_version, sizeof(e->bios_version));
+	copy_name(e->gpu_name, d->gpu ? d->gpu->name : NULL, sizeof(e->gpu_name));
+	copy_name(e->mem_name, d->mem ? d->mem->name : NULL, sizeof(e->mem_name));
+	e->rom_hash = d->fp.valid ? d->fp.rom_hash : 0;
+}
+
+static int compare_entries(const snapshot_entry_t *x, const snapshot_entry_t *y)
+{
+	if (x->pcidomain != y->pcidomain)
+		return x->pcidomain < y->pcidomain ? -1 : 1;
+	if (x->pcibus != y->pcibus)
+		return x->pcibus - y->pcibus;
+	if (x->pcidev != y->pcidev)
+		return x->pcidev - y->pcidev;
+	return x->pcifunc - y->pcifunc;
+}
+
+static int compare_entries_qsort(const void *a, const void *b)
+{
+	return compare_entries(a, b);
+}
+
+/***********************************************
+ * Fields
+ ***********************************************/
+static void get_pci(const snapshot_entry_t *e, char *buf, size_t len)
+{
+	snprintf(buf, len, "%04x:%02x:%02x.%x", e->pcidomain, e->pcibus, e->pcidev, e->pcifunc);
+}
+
+static void get_device_id(const snapshot_entry_t *e, char *buf, size_t len)
+{
+	snprintf(buf, len, "0x%04x", e->device_id);
+}
+
+static void get_revision(const snapshot_entry_t *e, char *buf, size_t len)
+{
+	snprintf(buf, len, "0x%02x", e->pcirev);
+}
+
+static void get_subvendor(const snapshot_entry_t *e, char *buf, size_t len)
+{
+	snprintf(buf, len, "0x%04x", e->subvendor);
+}
+
+static void get_subdevice(const snapshot_entry_t *e, char *buf, size_t len)
+{
+	snprintf(buf, len, "0x%04x", e->subdevice);
+}
+
+static void get_name(const snapshot_entry_t *e, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", e->gpu_name);
+}
+
+static void get_bios_version(const snapshot_entry_t *e, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", e->bios_version);
+}
+
+static void get_memconfig(const snapshot_entry_t *e, char *buf, size_t len)
+{
+	// zero is what a run that could not read the register reports
+	if (e->memconfig)
+		snprintf(buf, len, "0x%x", e->memconfig);
+	else
+		buf[0] = 0;
+}
+
+static void get_mem_name(const snapshot_entry_t *e, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s", e->mem_name);
+}
+
+// catches reflashes that kept the version string
+static void get_rom_hash(const snapshot_entry_t *e, char *buf, size_t len)
+{
+	if (e->rom_hash)
+		snprintf(buf, len, "%016llx", (unsigned long long)e->rom_hash);
+	else
+		buf[0] = 0;
+}
+
+// same names as the json and csv output
+static const snapshot_field_t fields[] = {
+	{ "device_id", get_device_id },
+	{ "revision", get_revision },
+	{ "subvendor", get_subvendor },
+	{ "subdevice", get_subdevice },
+	{ "name", get_name },
+	{ "bios_version", get_bios_version },
+	{ "memconfig", get_memconfig },
+	{ "mem_name", get_mem_name },
+	{ "rom_hash", get_rom_hash },
+};
+
+#define NUM_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+/***********************************************
+ * Files
+ ***********************************************/
+bool snapshot_save(const char *path, const gpu_t *list)
+{
+	char tmp[1100];
+	snapshot_header_t h;
+	snapshot_entry_t e;
+	const gpu_t *d;
+	outbuf_t out;
+	bool ok;
+	int fd;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+	h.version = SNAPSHOT_VERSION;
+	for (d = list; d; d = d->next)
+		++h.count;
+
+	if ((fd = output_open_atomic(path, tmp, sizeof(tmp))) < 0)
+		return false;
+
+	outbuf_init(&out, fd);
+	outbuf_write(&out, (const char *)&h, sizeof(h));
+	for (d = list; d; d = d->next) {
+		entry_from_gpu(&e, d);
+		outbuf_write(&out, (const char *)&e, sizeof(e));
+	}
+
+	ok = outbuf_flush(&out);
+	outbuf_free(&out);
+
+	if (!ok) {
+		close(fd);
+		unlink(tmp);
+		return false;
+	}
+
+	return output_commit_atomic(fd, tmp, path);
+}
+
+// all entries of a snapshot file, sorted by PCI address
+static snapshot_entry_t *snapshot_load(const char *path, size_t *count)
+{
+	snapshot_header_t h;
+	snapshot_entry_t *entries = NULL;
+	unsigned char *buf = NULL;
+	size_t entry_size, size, i;
+	struct stat st;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0 || read(fd, &h, sizeof(h)) != sizeof(h) ||
+	    memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0 ||
+	    (h.version != 1 && h.version != SNAPSHOT_VERSION))
+		goto invalid;
+
+	entry_size = h.version == 1 ? SNAPSHOT_V1_ENTRY : sizeof(snapshot_entry_t);
+	size = (size_t)h.count * entry_size;
+
+	if ((uint64_t)st.st_size != sizeof(h) + (uint64_t)size)
+		goto invalid;
+
+	// one spare entry, so an empty snapshot is not mistaken for an error
+	if ((entries = (snapshot_entry_t *)calloc(h.count + 1, sizeof(snapshot_entry_t))) == NULL ||
+	    (buf = (unsigned char *)malloc(size + 1)) == NULL) {
+		free(entries);
+		close(fd);
+		return NULL;
+	}
+
+	if (read(fd, buf, size) != (ssize_t)size)
+		goto invalid;
+
+	// older entries are a prefix of the current ones, the rest stays unknown
+	for (i = 0; i < h.count; ++i)
+		memcpy(&entries[i], buf + i * entry_size, entry_size);
+
+	free(buf);
+	close(fd);
+
+	qsort(entries, h.count, sizeof(snapshot_entry_t), compare_entries_qsort);
+	*count = h.count;
+
+	return entries;
+
+invalid:
+	free(entries);
+	free(buf);
+	close(fd);
+	errno = EINVAL;
+	return NULL;
+}
+
+/***********************************************
+ * Diff
+ ***********************************************/
+typedef enum {
+	CHANGE_ADDED,
+	CHANGE_REMOVED,
+	CHANGE_CHANGED,
+} change_t;
+
+static const char *change_names[] = {
+	[CHANGE_ADDED] = "added",
+	[CHANGE_REMOVED] = "removed",
+	[CHANGE_CHANGED] = "changed",
+};
+
+typedef struct {
+	output_format_t format;
+	outbuf_t out;
+	long count;
+} diff_t;
+
+static void describe(const snapshot_entry_t *e, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s %s %s",
+		 e->gpu_name[0] ? e->gpu_name : "Unknown GPU",
+		 e->bios_version[0] ? e->bios_version : BLANK_BIOS_VER,
+		 e->mem_name[0] ? e->mem_name : "Unknown Memory");
+}
+
+static void diff_record(diff_t *diff, change_t change, const snapshot_entry_t *e,
+			const char *field, const char *old, const char *new)
+{
+	outbuf_t *out = &diff->out;
+	char pci[16];
+
+	get_pci(e, pci, sizeof(pci));
+
+	switch (diff->format) {
+	case OUTPUT_JSON:
+		outbuf_printf(out, "%s\n  {\"pci\": \"%s\", \"change\": \"%s\"", diff->count ? "," : "", pci, change_names[change]);
+		if (field != NULL) {
+			outbuf_puts(out, ", \"field\": \"");
+			outbuf_puts(out, field);
+			outbuf_puts(out, "\"");
+		}
+		if (old != NULL) {
+			outbuf_puts(out, ", \"old\": ");
+			outbuf_json_string(out, old);
+		}
+		if (new != NULL) {
+			outbuf_puts(out, ", \"new\": ");
+			outbuf_json_string(out, new);
+		}
+		outbuf_puts(out, "}");
+		break;
+	case OUTPUT_CSV:
+		outbuf_printf(out, "%s,%s,%s,", pci, change_names[change], field ? field : "");
+		outbuf_csv_string(out, old ? old : "");
+		outbuf_puts(out, ",");
+		outbuf_csv_string(out, new ? new : "");
+		outbuf_puts(out, "\n");
+		break;
+	default:
+		if (change == CHANGE_ADDED)
+			outbuf_printf(out, "+ %s %s\n", pci, new);
+		else if (change == CHANGE_REMOVED)
+			outbuf_printf(out, "- %s %s\n", pci, old);
+		else
+			outbuf_printf(out, "~ %s %s: %s -> %s\n", pci, field, old, new);
+		break;
+	}
+
+	++diff->count;
+}
+
+static void diff_device(diff_t *diff, const snapshot_entry_t *old, const snapshot_entry_t *new)
+{
+	char a[128], b[128];
+	size_t i;
+
+	for (i = 0; i < NUM_FIELDS; ++i) {
+		fields[i].get(old, a, sizeof(a));
+		fields[i].get(new, b, sizeof(b));
+
+		if (a[0] && b[0] && strcmp(a, b) != 0)
+			diff_record(diff, CHANGE_CHANGED, new, fields[i].name, a, b);
+	}
+}
+
+long snapshot_diff(const char *path, const gpu_t *list, output_format_t format, int fd)
+{
+	snapshot_entry_t *entries, live;
+	size_t count, i = 0;
+	const gpu_t *d = list;
+	char buf[256];
+	diff_t diff;
+	int cmp;
+
+	if ((entries = snapshot_load(path, &count)) == NULL)
+		return -1;
+
+	diff.format = format;
+	diff.count = 0;
+	outbuf_init(&diff.out, fd);
+
+	if (format == OUTPUT_JSON)
+		outbuf_puts(&diff.out, "[");
+	else if (format == OUTPUT_CSV)
+		outbuf_puts(&diff.out, "pci,change,field,old,new\n");
+
+	// both sides are in PCI order, so a single merge pass finds every change
+	while (i < count || d != NULL) {
+		if (d != NULL)
+			entry_from_gpu(&live, d);
+
+		if (d == NULL)
+			cmp = -1;
+		else if (i == count)
+			cmp = 1;
+		else
+			cmp = compare_entries(&entries[i], &live);
+
+		if (cmp < 0) {
+			describe(&entries[i], buf, sizeof(buf));
+			diff_record(&diff, CHANGE_REMOVED, &entries[i], NULL, buf, NULL);
+			++i;
+		} else if (cmp > 0) {
+			describe(&live, buf, sizeof(buf));
+			diff_record(&diff, CHANGE_ADDED, &live, NULL, NULL, buf);
+			d = d->next;
+		} else {
+			diff_device(&diff, &entries[i], &live);
+			++i;
+			d = d->next;
+		}
+	}
+
+	if (format == OUTPUT_JSON)
+		outbuf_puts(&diff.out, diff.count ? "\n]\n" : "]\n");
+
+	outbuf_flush(&diff.out);
+	outbuf_free(&diff.out);
+	free(entries);
+
+	return diff.count;
+}
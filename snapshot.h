@@ -0,0 +1,28 @@
+/*
+ * AMDGPUInfo - inventory snapshots
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "gpu.h"
+#include "output.h"
+
+// write the device list to path, replacing it atomically
+bool snapshot_save(const char *path, const gpu_t *list);
+
+/*
+ * Compare the device list against the snapshot in path and write one
+ * record per added, removed or changed device field to fd. Fields that
+ * are unknown on either side, like the VBIOS version of a run without
+ * root, are not changes.
+ * Returns the number of changes, or -1 if the snapshot could not be read.
+ */
+long snapshot_diff(const char *path, const gpu_t *list, output_format_t format, int fd);
+
+#endif
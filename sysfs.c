@@ -0,0 +1,160 @@
+/*
+ * AMDGPUInfo - device enumeration straight from sysfs
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * libpci's bus scan looks at every function on the host and reads
+ * config space for each of them. Here the vendor and class attributes
+ * are checked first, so only AMD display devices cost more than two
+ * small reads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sysfs.h"
+
+#define PCI_CLASS_DISPLAY 0x03
+
+// read a whole small attribute file
+static bool sysfs_read_file(hwio_t *hw, const char *dir, const char *name, char *buf, size_t len)
+{
+	char path[1100];
+	ssize_t n;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+	if ((n = hwio_read(hw, path, buf, len - 1, 0)) < 0)
+		return false;
+
+	buf[n] = 0;
+
+	return true;
+}
+
+// read a single line attribute, without the trailing newline
+bool sysfs_read_attr(hwio_t *hw, const char *dir, const char *name, char *buf, size_t len)
+{
+	if (!sysfs_read_file(hw, dir, name, buf, len))
+		return false;
+
+	buf[strcspn(buf, "\n")] = 0;
+
+	return true;
+}
+
+bool sysfs_read_hex(hwio_t *hw, const char *dir, const char *name, unsigned long *val)
+{
+	char buf[32], *end;
+
+	if (!sysfs_read_attr(hw, dir, name, buf, sizeof(buf)))
+		return false;
+
+	*val = strtoul(buf, &end, 16);
+
+	return end != buf;
+}
+
+// BAR addresses and sizes from the resource attribute, one line per BAR
+static void sysfs_read_resources(hwio_t *hw, const char *dir, gpu_t *d)
+{
+	char buf[1024], *line, *save = NULL;
+	unsigned long long start, end, flags;
+	int i = 0;
+
+	if (!sysfs_read_file(hw, dir, "resource", buf, sizeof(buf)))
+		return;
+
+	for (line = strtok_r(buf, "\n", &save); line && i < 6; line = strtok_r(NULL, "\n", &save), ++i)
+	{
+		if (sscanf(line, "%llx %llx %llx", &start, &end, &flags) != 3 || start == 0)
+			continue;
+
+		d->base_addr[i] = start;
+		d->size[i] = end - start + 1;
+	}
+}
+
+/*
+ * Add the device sysfs_path/devices/name if it is a discrete AMD GPU.
+ * Returns 1 if it was added, 0 if it is not one, -1 if new_device failed.
+ */
+int sysfs_add_device(hwio_t *hw, const char *sysfs_path, const char *name, new_device_fn_t new_device, void *arg)
+{
+	char dir[1024];
+	unsigned long vendor, class, device, subvendor, subdevice, rev;
+	unsigned int domain, bus, dev, func;
+	gpu_t *d;
+
+	if (sscanf(name, "%x:%x:%x.%x", &domain, &bus, &dev, &func) != 4)
+		return 0;
+
+	snprintf(dir, sizeof(dir), "%s/devices/%s", sysfs_path, name);
+
+	if (!sysfs_read_hex(hw, dir, "vendor", &vendor) || vendor != AMD_PCI_VENDOR_ID)
+		return 0;
+
+	if (!sysfs_read_hex(hw, dir, "class", &class) || (class >> 16) != PCI_CLASS_DISPLAY)
+		return 0;
+
+	if (!sysfs_read_hex(hw, dir, "device", &device))
+		return 0;
+
+	// skip APUs
+	if (is_apu((unsigned int)device))
+		return 0;
+
+	if ((d = new_device(arg)) == NULL)
+		return -1;
+
+	if (!sysfs_read_hex(hw, dir, "subsystem_vendor", &subvendor))
+		subvendor = 0;
+	if (!sysfs_read_hex(hw, dir, "subsystem_device", &subdevice))
+		subdevice = 0;
+	if (!sysfs_read_hex(hw, dir, "revision", &rev))
+		rev = 0;
+
+	d->vendor_id = AMD_PCI_VENDOR_ID;
+	d->device_id = (u16)device;
+	d->pcidomain = (int)domain;
+	d->pcibus = (u8)bus;
+	d->pcidev = (u8)dev;
+	d->pcifunc = (u8)func;
+	d->subvendor = (u32)subvendor;
+	d->subdevice = (u32)subdevice;
+	d->pcirev = (u8)rev;
+	d->path = strdup(dir);
+
+	sysfs_read_resources(hw, dir, d);
+
+	return 1;
+}
+
+/*
+ * Add every discrete AMD GPU found under sysfs_path/devices.
+ * Returns the number of devices added, or -1 if the directory could not
+ * be listed, in which case the caller should fall back to libpci.
+ */
+int sysfs_enumerate(hwio_t *hw, const char *sysfs_path, new_device_fn_t new_device, void *arg)
+{
+	char dir[1024], **names;
+	size_t count_names, n;
+	int ret, count = 0;
+
+	snprintf(dir, sizeof(dir), "%s/devices", sysfs_path);
+
+	if ((names = hwio_listdir(hw, dir, &count_names)) == NULL)
+		return -1;
+
+	for (n = 0; n < count_names; ++n)
+	{
+		if ((ret = sysfs_add_device(hw, sysfs_path, names[n], new_device, arg)) < 0)
+			break;
+		count += ret;
+	}
+
+	hwio_free_list(names, count_names);
+
+	return count;
+}
@@ -0,0 +1,24 @@
+/*
+ * AMDGPUInfo - device enumeration straight from sysfs
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SYSFS_H
+#define SYSFS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "gpu.h"
+#include "hwio.h"
+
+// allocates and links a new gpu_t, NULL on failure
+typedef gpu_t *(*new_device_fn_t)(void *arg);
+
+bool sysfs_read_attr(hwio_t *hw, const char *dir, const char *name, char *buf, size_t len);
+bool sysfs_read_hex(hwio_t *hw, const char *dir, const char *name, unsigned long *val);
+int sysfs_add_device(hwio_t *hw, const char *sysfs_path, const char *name, new_device_fn_t new_device, void *arg);
+int sysfs_enumerate(hwio_t *hw, const char *sysfs_path, new_device_fn_t new_device, void *arg);
+
+#endif
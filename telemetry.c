@@ -0,0 +1,458 @@
+/*
+ * AMDGPUInfo - live telemetry sampling
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Attribute files are opened once and reread with pread(2), and samples
+ * go into rings allocated up front, so a sample costs one small read
+ * per value and nothing else. This bypasses hwio: a trace of a
+ * sampling run would be mostly the same few files over and over.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+#include "timing.h"
+
+#define NS_PER_SEC 1000000000ull
+
+enum {
+	METRIC_TEMP = 0,
+	METRIC_POWER,
+	METRIC_FAN,
+	METRIC_GPU_BUSY,
+	METRIC_MEM_BUSY,
+	METRIC_VRAM_USED,
+	METRICS
+};
+
+typedef struct {
+	const char *name;
+	const char *files[2];	// first one that opens wins
+	bool hwmon;		// files are in the hwmon directory
+	double scale;		// raw value per unit
+} metric_t;
+
+static const metric_t metrics[METRICS] = {
+	[METRIC_TEMP] = { "temp_c", { "temp1_input" }, true, 1000.0 },
+	[METRIC_POWER] = { "power_w", { "power1_average", "power1_input" }, true, 1000000.0 },
+	[METRIC_FAN] = { "fan_rpm", { "fan1_input" }, true, 1.0 },
+	[METRIC_GPU_BUSY] = { "gpu_busy_pct", { "gpu_busy_percent" }, false, 1.0 },
+	[METRIC_MEM_BUSY] = { "mem_busy_pct", { "mem_busy_percent" }, false, 1.0 },
+	[METRIC_VRAM_USED] = { "vram_used_mib", { "mem_info_vram_used" }, false, 1048576.0 },
+};
+
+typedef struct {
+	double min, max, sum;
+	unsigned long count;
+	double first, last;	// rate of change over the window
+	uint64_t first_ns, last_ns;
+} stats_t;
+
+typedef struct {
+	const gpu_t *gpu;
+	char pci[16];
+	int fd[METRICS];
+	double *ring;		// capacity rows of METRICS values, NAN when unreadable
+	uint64_t *stamp;	// capacity sample times
+	size_t head, count;
+	stats_t total[METRICS];
+} watch_gpu_t;
+
+typedef struct {
+	watch_gpu_t *gpus;
+	size_t count, capacity;
+	output_format_t format;
+	outbuf_t out;
+	uint64_t start, last;	// first and latest sample
+	bool first_record;
+} watch_t;
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+/***********************************************
+ * Sampling
+ ***********************************************/
+
+// the hwmon directory has a numbered name, hwmon/hwmonN
+static bool find_hwmon(const char *devpath, char *buf, size_t len)
+{
+	char dir[1100];
+	struct dirent *e;
+	DIR *d;
+	bool found = false;
+
+	snprintf(dir, sizeof(dir), "%s/hwmon", devpath);
+
+	if ((d = opendir(dir)) == NULL)
+		return false;
+
+	while ((e = readdir(d)) != NULL) {
+		if (!strncmp(e->d_name, "hwmon", 5)) {
+			snprintf(buf, len, "%s/%s", dir, e->d_name);
+			found = true;
+			break;
+		}
+	}
+
+	closedir(d);
+
+	return found;
+}
+
+static void open_metrics(watch_gpu_t *g)
+{
+	char hwmon[1400], path[1500];
+	bool have_hwmon;
+	int i, j;
+
+	have_hwmon = g->gpu->path && find_hwmon(g->gpu->path, hwmon, sizeof(hwmon));
+
+	for (i = 0; i < METRICS; ++i) {
+		g->fd[i] = -1;
+
+		if (g->gpu->path == NULL || (metrics[i].hwmon && !have_hwmon))
+			continue;
+
+		for (j = 0; j < 2 && g->fd[i] < 0 && metrics[i].files[j]; ++j) {
+			snprintf(path, sizeof(path), "%s/%s", metrics[i].hwmon ? hwmon : g->gpu->path, metrics[i].files[j]);
+			g->fd[i] = open(path, O_RDONLY | O_CLOEXEC);
+		}
+	}
+}
+
+static double read_metric(int fd, double scale)
+{
+	char buf[32], *end;
+	long long raw;
+	ssize_t n;
+
+	if (fd < 0 || (n = pread(fd, buf, sizeof(buf) - 1, 0)) <= 0)
+		return NAN;
+
+	buf[n] = 0;
+	raw = strtoll(buf, &end, 10);
+
+	return end != buf ? (double)raw / scale : NAN;
+}
+
+static void stats_add(stats_t *s, double v, uint64_t now)
+{
+	if (isnan(v))
+		return;
+
+	if (s->count == 0) {
+		s->min = s->max = s->first = v;
+		s->first_ns = now;
+	}
+
+	if (v < s->min)
+		s->min = v;
+	if (v > s->max)
+		s->max = v;
+	s->sum += v;
+	s->last = v;
+	s->last_ns = now;
+	++s->count;
+}
+
+static void sample(watch_t *w, uint64_t now)
+{
+	watch_gpu_t *g;
+	double *row, v;
+	size_t i;
+	int m;
+
+	for (i = 0; i < w->count; ++i) {
+		g = &w->gpus[i];
+		row = &g->ring[g->head * METRICS];
+
+		for (m = 0; m < METRICS; ++m) {
+			v = read_metric(g->fd[m], metrics[m].scale);
+			row[m] = v;
+			stats_add(&g->total[m], v, now);
+		}
+
+		g->stamp[g->head] = now;
+		g->head = (g->head + 1) % w->capacity;
+		if (g->count < w->capacity)
+			++g->count;
+	}
+}
+
+// everything in the ring, oldest first
+static void window_stats(const watch_t *w, const watch_gpu_t *g, stats_t *stats)
+{
+	size_t i, slot;
+	int m;
+
+	memset(stats, 0, sizeof(stats_t) * METRICS);
+
+	for (i = 0; i < g->count; ++i) {
+		slot = (g->head + w->capacity - g->count + i) % w->capacity;
+		for (m = 0; m < METRICS; ++m)
+			stats_add(&stats[m], g->ring[slot * METRICS + m], g->stamp[slot]);
+	}
+}
+
+static double stats_rate(const stats_t *s)
+{
+	if (s->count < 2 || s->last_ns == s->first_ns)
+		return 0.0;
+
+	return (s->last - s->first) * (double)NS_PER_SEC / (double)(s->last_ns - s->first_ns);
+}
+
+/***********************************************
+ * Reports
+ ***********************************************/
+static void report_text(watch_t *w, const watch_gpu_t *g, const stats_t *stats, const char *when,
+			unsigned long taken, double sps)
+{
+	outbuf_t *out = &w->out;
+	int m;
+
+	outbuf_printf(out, "%s %s", when, g->pci);
+
+	for (m = 0; m < METRICS; ++m) {
+		if (stats[m].count == 0)
+			continue;
+		outbuf_printf(out, "  %s %.1f/%.1f/%.1f %+.2f/s", metrics[m].name,
+			      stats[m].min, stats[m].sum / (double)stats[m].count, stats[m].max,
+			      stats_rate(&stats[m]));
+	}
+
+	if (sps > 0.0)
+		outbuf_printf(out, "  samples %lu (%.1f/s)", taken, sps);
+
+	outbuf_puts(out, "\n");
+}
+
+// one object per line, so a consumer can read them as they come
+static void report_json(watch_t *w, const watch_gpu_t *g, const stats_t *stats, double time,
+			unsigned long taken, double sps)
+{
+	outbuf_t *out = &w->out;
+	int m;
+
+	outbuf_printf(out, "{\"time\": %.3f, \"pci\": \"%s\", \"summary\": %s", time, g->pci, sps > 0.0 ? "true" : "false");
+
+	if (sps > 0.0)
+		outbuf_printf(out, ", \"samples\": %lu, \"samples_per_sec\": %.3f", taken, sps);
+
+	for (m = 0; m < METRICS; ++m) {
+		if (stats[m].count == 0) {
+			outbuf_printf(out, ", \"%s\": null", metrics[m].name);
+			continue;
+		}
+		outbuf_printf(out, ", \"%s\": {\"samples\": %lu, \"last\": %g, \"min\": %g, \"avg\": %g, \"max\": %g, \"rate\": %g}",
+			      metrics[m].name, stats[m].count, stats[m].last, stats[m].min,
+			      stats[m].sum / (double)stats[m].count, stats[m].max, stats_rate(&stats[m]));
+	}
+
+	outbuf_puts(out, "}\n");
+}
+
+// long format, like --timings
+static void report_csv(watch_t *w, const watch_gpu_t *g, const stats_t *stats, const char *when)
+{
+	outbuf_t *out = &w->out;
+	int m;
+
+	if (w->first_record) {
+		outbuf_puts(out, "time,pci,metric,samples,last,min,avg,max,rate\n");
+		w->first_record = false;
+	}
+
+	for (m = 0; m < METRICS; ++m) {
+		if (stats[m].count == 0)
+			continue;
+		outbuf_printf(out, "%s,%s,%s,%lu,%g,%g,%g,%g,%g\n", when, g->pci, metrics[m].name,
+			      stats[m].count, stats[m].last, stats[m].min,
+			      stats[m].sum / (double)stats[m].count, stats[m].max, stats_rate(&stats[m]));
+	}
+}
+
+// the summary covers the whole run, the other reports the last window
+static void report(watch_t *w, const watch_gpu_t *g, const stats_t *stats,
+		   unsigned long taken, bool summary)
+{
+	double time = (double)(w->last - w->start) / (double)NS_PER_SEC;
+	double sps = 0.0;
+	char when[32];
+
+	if (summary)
+		sps = (taken > 1 && w->last > w->start) ? (double)(taken - 1) / time : 1.0;
+
+	if (summary)
+		snprintf(when, sizeof(when), "summary");
+	else
+		snprintf(when, sizeof(when), "%.3f", time);
+
+	if (w->format == OUTPUT_JSON)
+		report_json(w, g, stats, time, taken, sps);
+	else if (w->format == OUTPUT_CSV)
+		report_csv(w, g, stats, when);
+	else
+		report_text(w, g, stats, when, taken, sps);
+}
+
+/***********************************************
+ * Loop
+ ***********************************************/
+static bool watch_init(watch_t *w, const gpu_t *list, size_t capacity, output_format_t format, int fd)
+{
+	const gpu_t *d;
+	size_t i;
+	int m;
+
+	memset(w, 0, sizeof(*w));
+
+	for (d = list; d; d = d->next)
+		++w->count;
+
+	w->capacity = capacity;
+	w->format = format;
+	w->first_record = true;
+	outbuf_init(&w->out, fd);
+
+	if (w->count == 0)
+		return true;
+
+	w->gpus = (watch_gpu_t *)calloc(w->count, sizeof(watch_gpu_t));
+	if (w->gpus == NULL)
+		return false;
+
+	// before anything can fail, watch_free() closes what is not -1
+	for (i = 0; i < w->count; ++i) {
+		for (m = 0; m < METRICS; ++m)
+			w->gpus[i].fd[m] = -1;
+	}
+
+	for (i = 0, d = list; d; d = d->next, ++i) {
+		w->gpus[i].gpu = d;
+		snprintf(w->gpus[i].pci, sizeof(w->gpus[i].pci), "%04x:%02x:%02x.%x", d->pcidomain, d->pcibus, d->pcidev, d->pcifunc);
+		w->gpus[i].ring = (double *)malloc(sizeof(double) * METRICS * capacity);
+		w->gpus[i].stamp = (uint64_t *)malloc(sizeof(uint64_t) * capacity);
+		if (w->gpus[i].ring == NULL || w->gpus[i].stamp == NULL)
+			return false;
+		open_metrics(&w->gpus[i]);
+	}
+
+	return true;
+}
+
+static void watch_free(watch_t *w)
+{
+	size_t i;
+	int m;
+
+	for (i = 0; i < w->count && w->gpus; ++i) {
+		for (m = 0; m < METRICS; ++m) {
+			if (w->gpus[i].fd[m] >= 0)
+				close(w->gpus[i].fd[m]);
+		}
+		free(w->gpus[i].ring);
+		free(w->gpus[i].stamp);
+	}
+
+	free(w->gpus);
+	outbuf_free(&w->out);
+}
+
+static void sleep_until(uint64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t)(ns / NS_PER_SEC);
+	ts.tv_nsec = (long)(ns % NS_PER_SEC);
+
+	while (!stop && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+long telemetry_watch(const gpu_t *list, double interval, unsigned long samples,
+		     output_format_t format, int fd)
+{
+	struct sigaction sa, old_int, old_term;
+	stats_t stats[METRICS];
+	uint64_t step, next, now;
+	size_t per_report, i;
+	unsigned long taken = 0;
+	watch_t w;
+	bool ok;
+
+	if (!(interval >= TELEMETRY_MIN_INTERVAL))
+		return -1;
+
+	step = (uint64_t)(interval * (double)NS_PER_SEC);
+
+	// a ring holds one report's worth of samples
+	per_report = step >= NS_PER_SEC ? 1 : (size_t)((NS_PER_SEC + step - 1) / step);
+
+	if (!watch_init(&w, list, per_report, format, fd)) {
+		watch_free(&w);
+		return -1;
+	}
+
+	stop = 0;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, &old_int);
+	sigaction(SIGTERM, &sa, &old_term);
+
+	w.start = next = timing_now();
+
+	while (!stop && (samples == 0 || taken < samples)) {
+		now = timing_now();
+		sample(&w, now);
+		w.last = now;
+		++taken;
+
+		if (taken % per_report == 0) {
+			for (i = 0; i < w.count; ++i) {
+				window_stats(&w, &w.gpus[i], stats);
+				report(&w, &w.gpus[i], stats, taken, false);
+			}
+			if (!outbuf_flush(&w.out))
+				break;
+		}
+
+		if (samples != 0 && taken >= samples)
+			break;
+
+		// fixed schedule, a slow sample does not push the later ones back
+		next += step;
+		now = timing_now();
+		if (next < now)
+			next = now;
+		sleep_until(next);
+	}
+
+	for (i = 0; i < w.count; ++i)
+		report(&w, &w.gpus[i], w.gpus[i].total, taken, true);
+
+	ok = outbuf_flush(&w.out);
+
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+	watch_free(&w);
+
+	return ok ? (long)taken : -1;
+}
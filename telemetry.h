@@ -0,0 +1,29 @@
+/*
+ * AMDGPUInfo - live telemetry sampling
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "gpu.h"
+#include "output.h"
+
+// shortest interval, in seconds, the rings hold a second of samples
+#define TELEMETRY_MIN_INTERVAL 0.001
+
+/*
+ * Sample temperature, power, fan speed, GPU and memory busy and VRAM
+ * use of every device every interval seconds, until samples have been
+ * taken (0 for no limit) or SIGINT/SIGTERM. Once per second, or per
+ * sample when sampling slower, min/avg/max and the rate of change of
+ * each value since the previous report are written to fd, and totals
+ * for the whole run at the end. interval must be at least
+ * TELEMETRY_MIN_INTERVAL.
+ * Returns the number of samples taken, or -1 on error.
+ */
+long telemetry_watch(const gpu_t *list, double interval, unsigned long samples,
+		     output_format_t format, int fd);
+
+#endif
@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+#
+# AMDGPUInfo - compare the report on a synthetic rig to a known good one
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Usage: replay.py amdgpuinfo trace sysfs format expected
+#
+# Replays a trace written by tools/gen-trace.py, with the same options
+# meson.build uses, and fails with a diff when the report differs from
+# the expected file. After an intended change of the output, write the
+# new one with
+#
+#   tools/gen-trace.py -n 32 --sysfs /test/sys --rom-size 4096 \
+#       data/gputypes.txt test.trace
+#   amdgpuinfo --replay test.trace --sysfs /test/sys -f FORMAT \
+#       | grep -v '^AMDGPUInfo v' > tests/replay-32.EXT
+#
+# and likewise for tests/straps-8.json, from -n 8 --straps.
+
+import difflib
+import subprocess
+import sys
+
+
+def main():
+    if len(sys.argv) != 6:
+        sys.exit('usage: %s amdgpuinfo trace sysfs format expected' % sys.argv[0])
+
+    binary, trace, sysfs, fmt, expected = sys.argv[1:]
+
+    cmd = [binary, '--replay', trace, '--sysfs', sysfs, '-f', fmt]
+    p = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+    if p.returncode != 0:
+        sys.exit('%s exited with %d:\n%s' % (binary, p.returncode, p.stderr))
+
+    # the banner carries the version, which is not what is tested here
+    lines = p.stdout.splitlines(True)
+    if lines and lines[0].startswith('AMDGPUInfo v'):
+        lines = lines[1:]
+
+    with open(expected) as f:
+        want = f.readlines()
+
+    if lines != want:
+        sys.stdout.writelines(difflib.unified_diff(want, lines, expected, 'amdgpuinfo -f ' + fmt))
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
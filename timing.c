@@ -0,0 +1,38 @@
+/*
+ * AMDGPUInfo - per-phase timings
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <time.h>
+
+#include "timing.h"
+
+const char *const timing_run_names[TIME_RUN_PHASES] = {
+	[TIME_PCI_INIT] = "pci_init",
+	[TIME_ENUMERATE] = "enumerate",
+	[TIME_CACHE] = "cache",
+	[TIME_PROBE] = "probe",
+	[TIME_NAMES] = "names",
+	[TIME_OUTPUT] = "output",
+	[TIME_TOTAL] = "total",
+};
+
+const char *const timing_device_names[TIME_DEVICE_PHASES] = {
+	[TIME_DEV_WAIT] = "lock_wait",
+	[TIME_DEV_UNLOCK] = "unlock",
+	[TIME_DEV_ROM] = "rom_read",
+	[TIME_DEV_RELOCK] = "relock",
+	[TIME_DEV_PARSE] = "parse",
+	[TIME_DEV_MMIO] = "mmio",
+	[TIME_DEV_TOTAL] = "total",
+};
+
+uint64_t timing_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
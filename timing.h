@@ -0,0 +1,42 @@
+/*
+ * AMDGPUInfo - per-phase timings
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+// phases of the whole run
+enum {
+	TIME_PCI_INIT = 0,	// pci_alloc() and pci_init()
+	TIME_ENUMERATE,		// sysfs listing or pci_scan_bus()
+	TIME_CACHE,		// probe cache lookups, stores are part of the probe
+	TIME_PROBE,		// all devices, wall clock
+	TIME_NAMES,		// pci.ids subsystem lookups
+	TIME_OUTPUT,
+	TIME_TOTAL,
+	TIME_RUN_PHASES
+};
+
+// phases of one device's probe
+enum {
+	TIME_DEV_WAIT = 0,	// waiting for another process probing the device
+	TIME_DEV_UNLOCK,	// enabling the rom attribute
+	TIME_DEV_ROM,		// reading the VBIOS
+	TIME_DEV_RELOCK,
+	TIME_DEV_PARSE,		// VBIOS parsing and table lookups
+	TIME_DEV_MMIO,		// memory configuration register
+	TIME_DEV_TOTAL,
+	TIME_DEVICE_PHASES
+};
+
+extern const char *const timing_run_names[TIME_RUN_PHASES];
+extern const char *const timing_device_names[TIME_DEVICE_PHASES];
+
+// CLOCK_MONOTONIC in nanoseconds
+uint64_t timing_now(void);
+
+#endif
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+#
+# AMDGPUInfo - generate the GPU and memory lookup tables
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Usage: gen-gpudb.py gputypes.txt memtypes.txt apus.txt subvendors.txt output.c
+#
+# Turns the plain text tables in data/ into C arrays plus a constant-time
+# index for each of them, so adding a board or memory chip stays a
+# one-line edit. See gpudb.c for the lookup side.
+
+import sys
+
+HASH_MULT = 0x9e3779b97f4a7c15
+MASK64 = (1 << 64) - 1
+
+MEM_TYPES = 16
+MEM_IDS = 17  # -1..15
+
+
+def parse(path, ncols):
+    rows = []
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            cols = line.split(None, ncols - 1)
+            if len(cols) != ncols:
+                sys.exit('%s:%d: expected %d columns' % (path, lineno, ncols))
+            rows.append((lineno, cols))
+    return rows
+
+
+def cstr(s):
+    return '"' + s.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
+
+# must match gpu_key() and GPUDB_HASH() in gpudb.c
+def gpu_key(device_id, subsys_id, rev_id):
+    return (subsys_id << 24) | (rev_id << 16) | device_id
+
+
+def gpu_hash(key, bits):
+    return ((key * HASH_MULT) & MASK64) >> (64 - bits)
+
+
+def gen_gputypes(path, out):
+    gpus = []
+    for lineno, (dev, sub, rev, asic, name) in parse(path, 5):
+        gpus.append((int(dev, 0), int(sub, 0), int(rev, 0), asic, name))
+
+    # open addressing with linear probing, at most half full
+    bits = 1
+    while (1 << bits) < 2 * len(gpus):
+        bits += 1
+    size = 1 << bits
+    index = [0] * size
+    seen = set()
+
+    for i, (dev, sub, rev, asic, name) in enumerate(gpus):
+        key = gpu_key(dev, sub, rev)
+        if key in seen:
+            continue  # first entry wins, like the old linear scan
+        seen.add(key)
+        slot = gpu_hash(key, bits)
+        while index[slot]:
+            slot = (slot + 1) & (size - 1)
+        index[slot] = i + 1
+
+    out.append('const gputype_t gputypes[] = {')
+    for dev, sub, rev, asic, name in gpus:
+        out.append('\t{ 0x%04x, 0x%x, 0x%02x, %s, %s },' % (dev, sub, rev, cstr(name), asic))
+    out.append('};')
+    out.append('const size_t gputypes_count = %d;' % len(gpus))
+    out.append('')
+    out.append('const unsigned int gputype_index_bits = %d;' % bits)
+    out.append('const unsigned short gputype_index[%d] = {' % size)
+    for i in range(0, size, 8):
+        out.append('\t' + ' '.join('%d,' % v for v in index[i:i + 8]))
+    out.append('};')
+    out.append('')
+
+
+def gen_memtypes(path, out):
+    mems = []
+    for lineno, (mtype, mfr, model, name) in parse(path, 4):
+        mems.append((mtype, int(mfr, 0), int(model, 0), name))
+
+    if len(mems) >= 255:
+        sys.exit('%s: too many memory types for an 8-bit index' % path)
+
+    out.append('const memtype_t memtypes[] = {')
+    for mtype, mfr, model, name in mems:
+        out.append('\t{ %s, %d, %d, %s },' % (mtype, mfr, model, cstr(name)))
+    out.append('};')
+    out.append('const size_t memtypes_count = %d;' % len(mems))
+    out.append('')
+
+    # direct index on the (type, manufacturer + 1, model + 1) nibbles
+    out.append('const unsigned char memtype_index[%d][%d][%d] = {' % (MEM_TYPES, MEM_IDS, MEM_IDS))
+    seen = set()
+    for i, (mtype, mfr, model, name) in enumerate(mems):
+        if mtype == 'MEM_UNKNOWN':
+            break  # the old scan stopped at the first MEM_UNKNOWN entry
+        key = (mtype, mfr, model)
+        if key in seen or not -1 <= mfr < MEM_IDS - 1 or not -1 <= model < MEM_IDS - 1:
+            continue
+        seen.add(key)
+        out.append('\t[%s][%d][%d] = %d,' % (mtype, mfr + 1, model + 1, i + 1))
+    out.append('};')
+    out.append('')
+
+
+def gen_apus(path, out):
+    apus = {}
+    for lineno, (dev, codename) in parse(path, 2):
+        apus.setdefault(int(dev, 0), codename)
+
+    # sorted for bsearch()
+    out.append('const unsigned short apu_ids[] = {')
+    ids = sorted(apus)
+    for i in range(0, len(ids), 8):
+        out.append('\t' + ' '.join('0x%04x,' % v for v in ids[i:i + 8]))
+    out.append('};')
+    out.append('const size_t apu_ids_count = %d;' % len(ids))
+    out.append('')
+
+
+def gen_subvendors(path, out):
+    vendors = {}
+    for lineno, (vendor, name) in parse(path, 2):
+        vendors.setdefault(int(vendor, 0), name)
+
+    # sorted for bsearch()
+    out.append('const subvendor_t subvendors[] = {')
+    for v in sorted(vendors):
+        out.append('\t{ 0x%04x, %s },' % (v, cstr(vendors[v])))
+    out.append('};')
+    out.append('const size_t subvendors_count = %d;' % len(vendors))
+    out.append('')
+
+
+def main():
+    if len(sys.argv) != 6:
+        sys.exit('usage: %s gputypes.txt memtypes.txt apus.txt subvendors.txt output.c' % sys.argv[0])
+
+    out = [
+        '/* Generated by gen-gpudb.py, do not edit. */',
+        '',
+        '#include "gpudb.h"',
+        '',
+    ]
+    gen_gputypes(sys.argv[1], out)
+    gen_memtypes(sys.argv[2], out)
+    gen_apus(sys.argv[3], out)
+    gen_subvendors(sys.argv[4], out)
+
+    with open(sys.argv[5], 'w') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+#
+# AMDGPUInfo - extract the board vendors of AMD GPUs from pci.ids
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Usage: gen-subvendors.py pci.ids subvendors.txt
+#
+# Collects every subsystem vendor listed under an AMD/ATI device and
+# writes their names in the data/subvendors.txt format, so the Subsystem
+# field does not need the whole pci.ids at run time.
+
+import sys
+
+AMD_VENDOR = 0x1002
+
+HEADER = '''\
+# Subsystem vendors: names of the board vendors found on AMD GPUs, looked
+# up by subvendor_name() for the Subsystem field.
+#
+# Columns: vendor_id name
+# These are the vendors of the subsystems pci.ids lists under AMD/ATI
+# (1002) devices, as written by tools/gen-subvendors.py. Vendors that are
+# missing are still looked up in the system pci.ids, unless --no-pci-ids.
+'''
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: %s pci.ids subvendors.txt' % sys.argv[0])
+
+    vendors = {}
+    wanted = {AMD_VENDOR}
+    vendor = None
+
+    with open(sys.argv[1], encoding='utf-8', errors='replace') as f:
+        for line in f:
+            line = line.rstrip('\n')
+            if not line or line.startswith('#'):
+                continue
+            # the device classes at the end are not vendors
+            if line.startswith('C '):
+                break
+            if not line.startswith('\t'):
+                vendor = int(line[:4], 16)
+                vendors[vendor] = line[4:].strip()
+            elif line.startswith('\t\t') and vendor == AMD_VENDOR:
+                wanted.add(int(line[2:6], 16))
+
+    with open(sys.argv[2], 'w') as out:
+        out.write(HEADER + '\n')
+        for v in sorted(wanted):
+            if v in vendors:
+                out.write('0x%04x   %s\n' % (v, vendors[v]))
+
+
+if __name__ == '__main__':
+    main()
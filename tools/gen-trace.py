@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+#
+# AMDGPUInfo - generate a synthetic hardware trace
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Usage: gen-trace.py [-n GPUS] [--sysfs PATH] [--rom-size BYTES] [--straps]
+#                     gputypes.txt output.trace
+#
+# Writes a trace in the format of hwio.h describing a rig with GPUS
+# boards taken round robin from gputypes.txt, each with a valid VBIOS
+# (including an ATOM VRAM_Info table) and a memory configuration
+# register, so that
+#
+#   amdgpuinfo --replay output.trace
+#
+# can exercise the whole probe on any machine.
+#
+# With --straps the Vega boards list two memory modules of different
+# vendors, the second one fitted. Every third board tells which in its
+# BIOS_SCRATCH_4 register, the next in amdgpu's mem_info_vram_vendor,
+# and the one after that not at all.
+
+import argparse
+import sys
+
+MEMCONFIGS = [
+    0x50000100,  # GDDR5 Samsung
+    0x50000300,  # GDDR5 Elpida
+    0x50000600,  # GDDR5 SK Hynix
+    0x50000f00,  # GDDR5 Micron
+    0x70000100,  # GDDR6 Samsung
+]
+
+HBM_MEMCONFIGS = [
+    0x60000100,  # HBM Samsung
+    0x60000600,  # HBM SK Hynix
+]
+
+MMIO_BASE = 0xfe600000
+MC_SEQ_MISC0 = 0xa80
+MC_SEQ_MISC0_FIJI = 0xa71
+
+# BIOS_SCRATCH_0 as FirmwareInfo gives it, a dword index into the
+# register BAR. It is the VBIOS that says, so this is made up.
+BIOS_SCRATCH_START = 0x5c9
+
+# amdgpu's mem_info_vram_vendor names
+VRAM_VENDORS = {0x1: 'samsung', 0x6: 'hynix'}
+
+
+def boards(path):
+    rows = []
+    with open(path) as f:
+        for line in f:
+            cols = line.split('#', 1)[0].split(None, 4)
+            if len(cols) != 5:
+                continue
+            device, subsys, rev, asic, name = cols
+            # the ids stand for themselves, 0 is "any" so pick something
+            rows.append((int(device, 0), int(subsys, 0) or 0x0b36,
+                         int(rev, 0) or 0xc1, asic))
+    return rows
+
+
+def u16(rom, offset, value):
+    rom[offset:offset + 2] = value.to_bytes(2, 'little')
+
+
+def vram_info(asic, memconfigs):
+    """VRAM_Info with a module per memory config, in the revision the ASIC uses"""
+    modules = bytearray()
+    for memconfig in memconfigs:
+        mem_type = (memconfig >> 28) << 4
+        vendor = (memconfig >> 8) & 0xf | ((memconfig >> 12) & 0xf) << 4
+        module = bytearray(40)
+        if asic in ('CHIP_VEGA10', 'CHIP_VEGA20', 'CHIP_NAVI10', 'CHIP_NAVI12', 'CHIP_NAVI14'):
+            u16(module, 20, len(module))
+            module[23] = mem_type
+        else:
+            u16(module, 4, len(module))
+            module[11] = mem_type
+        module[28] = vendor
+        modules += module
+    if asic in ('CHIP_VEGA10', 'CHIP_VEGA20', 'CHIP_NAVI10', 'CHIP_NAVI12', 'CHIP_NAVI14'):
+        crev = 3 if asic.startswith('CHIP_VEGA') else 4
+        table = bytearray(24)
+        table[20] = len(memconfigs)
+    else:
+        crev = 1
+        table = bytearray(20)
+        table[16] = len(memconfigs)
+    table += modules
+    u16(table, 0, len(table))
+    table[2] = 2
+    table[3] = crev
+    return table
+
+
+def firmware_info(scratch):
+    """FirmwareInfo v3.1, of which only the scratch registers matter"""
+    table = bytearray(0x40)
+    u16(table, 0, len(table))
+    table[2] = 3
+    table[3] = 1
+    table[24:28] = scratch.to_bytes(4, 'little')
+    return table
+
+
+def vbios(size, version, vram, firmware=None):
+    rom = bytearray(size)
+    rom[0:2] = b'\x55\xaa'
+    rom[2] = min(size // 512, 0xff)
+    rom[0x18:0x1a] = (0x40).to_bytes(2, 'little')
+    rom[0x40:0x44] = b'PCIR'
+    rom[0x50:0x52] = (size // 512).to_bytes(2, 'little')
+    rom[0x55] = 0x80
+    rom[0x6e:0x70] = (0x100).to_bytes(2, 'little')
+    rom[0x100:0x100 + len(version)] = version.encode()
+
+    # ATOM ROM header and a master data table pointing at VRAM_Info
+    u16(rom, 0x48, 0x200)
+    rom[0x204:0x208] = b'ATOM'
+    u16(rom, 0x21e, 0x300)
+    u16(rom, 0x220, 0x400)
+    u16(rom, 0x300, 4 + 81 * 2)
+    u16(rom, 0x400, 4 + 34 * 2)
+    u16(rom, 0x404 + 28 * 2, 0x500)
+    rom[0x500:0x500 + len(vram)] = vram
+    if firmware:
+        u16(rom, 0x404 + 4 * 2, 0x480)
+        rom[0x480:0x480 + len(firmware)] = firmware
+
+    # the legacy image sums to zero, or amdgpuinfo reports it as corrupt
+    rom[0x21] = -sum(rom[:rom[2] * 512]) & 0xff
+    return rom
+
+
+def path(p):
+    return p.replace('%', '%25').replace(' ', '%20')
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('-n', '--gpus', type=int, default=8)
+    ap.add_argument('--sysfs', default='/sys/bus/pci')
+    ap.add_argument('--rom-size', type=int, default=0x10000)
+    ap.add_argument('--straps', action='store_true')
+    ap.add_argument('gputypes')
+    ap.add_argument('output')
+    args = ap.parse_args()
+
+    if args.rom_size < 0x200 or args.rom_size % 512:
+        sys.exit('--rom-size must be a multiple of 512')
+
+    table = boards(args.gputypes)
+    if not table:
+        sys.exit('%s: no boards' % args.gputypes)
+
+    devices = ['0000:%02x:%02x.0' % (1 + i // 32, i % 32) for i in range(args.gpus)]
+    root = args.sysfs + '/devices'
+
+    with open(args.output, 'w') as out:
+        out.write('# amdgpuinfo trace v1\n')
+        out.write('D %s %s\n' % (path(root), ' '.join(devices)))
+
+        for i, bdf in enumerate(devices):
+            device, subsys, rev, asic = table[i % len(table)]
+            dev = path('%s/%s' % (root, bdf))
+            base = MMIO_BASE - i * 0x100000
+            attrs = {
+                'vendor': '0x1002',
+                'class': '0x030000',
+                'device': '0x%04x' % device,
+                'subsystem_vendor': '0x1682',
+                'subsystem_device': '0x%04x' % subsys,
+                'revision': '0x%02x' % rev,
+                'resource': ''.join('0x%016x 0x%016x 0x%016x\n' % r for r in [
+                    (0xe0000000 + i * 0x10000000, 0xefffffff + i * 0x10000000, 0x14220c),
+                    (0, 0, 0),
+                    (0xf0000000 + i * 0x200000, 0xf01fffff + i * 0x200000, 0x14220c),
+                    (0, 0, 0),
+                    (0xe000 + i * 0x100, 0xe0ff + i * 0x100, 0x40101),
+                    (base, base + 0x3ffff, 0x40200),
+                ]),
+            }
+            for name, value in attrs.items():
+                out.write('R %s/%s 0 %s\n' % (dev, name, (value + '\n').encode().hex()
+                                                 if name != 'resource' else value.encode().hex()))
+
+            rom = dev + '/rom'
+            out.write('W %s\n' % rom)
+            out.write('S %s %x\n' % (rom, args.rom_size))
+            vega = asic in ('CHIP_VEGA10', 'CHIP_VEGA20')
+            if vega:
+                memconfig = HBM_MEMCONFIGS[i % len(HBM_MEMCONFIGS)]
+            else:
+                memconfig = MEMCONFIGS[i % len(MEMCONFIGS)]
+            memconfigs, firmware = [memconfig], None
+            if args.straps and vega:
+                memconfigs.insert(0, HBM_MEMCONFIGS[(i + 1) % len(HBM_MEMCONFIGS)])
+                firmware = firmware_info(BIOS_SCRATCH_START)
+            image = vbios(args.rom_size, '113-SYNTH-%03d' % i, vram_info(asic, memconfigs), firmware)
+            out.write('R %s 0 %s\n' % (rom, image.hex()))
+
+            reg = MC_SEQ_MISC0_FIJI if asic == 'CHIP_FIJI' else MC_SEQ_MISC0
+            if not vega:
+                out.write('M %s/resource5 0 %x %x\n' % (dev, reg, memconfig))
+            elif args.straps and i % 3 == 0:
+                # ext_memory_id in bits 23:16 of BIOS_SCRATCH_4, module 1
+                out.write('M %s/resource5 0 %x %x\n' % (dev, BIOS_SCRATCH_START + 4, 1 << 16))
+            elif args.straps and i % 3 == 1:
+                vendor = VRAM_VENDORS[(memconfig >> 8) & 0xf]
+                out.write('R %s/mem_info_vram_vendor 0 %s\n' % (dev, (vendor + '\n').encode().hex()))
+
+
+if __name__ == '__main__':
+    main()
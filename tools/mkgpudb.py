@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+#
+# AMDGPUInfo - compile the runtime device database
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Usage: mkgpudb.py gpudb.h gputypes.txt memtypes.txt output.bin
+#
+# Builds the file loaded with --db from the same text tables as the
+# built-in ones, so a newer data/ can be pushed without a new binary.
+# The CHIP_* and MEM_* values are taken from gpudb.h. Layout, all
+# little-endian, see gpudb_load() in gpudb.c:
+#
+#   header   magic "AGIGPUDB", u32 version, u32 gpu_count, u32 gpu_offset,
+#            u32 mem_count, u32 mem_offset, u32 str_offset, u32 str_size,
+#            u32 reserved
+#   gpus     u32 subsys_id, u16 device_id, u8 rev_id, u8 asic_type,
+#            u32 name, u32 reserved; sorted by (subsys, rev, device)
+#   mems     u8 type, u8 manufacturer + 1, u8 model + 1, u8 reserved,
+#            u32 name; sorted by (type, manufacturer, model)
+#   strings  NUL terminated names, referenced by offset
+
+import importlib.util
+import os
+import re
+import struct
+import sys
+
+MAGIC = b'AGIGPUDB'
+VERSION = 1
+HEADER = struct.Struct('<8s8I')
+GPU = struct.Struct('<IHBBII')
+MEM = struct.Struct('<BBBBI')
+
+# share the table parser, so both builds read data/ the same way
+_spec = importlib.util.spec_from_file_location(
+    'gen_gpudb', os.path.join(os.path.dirname(os.path.abspath(__file__)), 'gen-gpudb.py'))
+gen_gpudb = importlib.util.module_from_spec(_spec)
+_spec.loader.exec_module(gen_gpudb)
+
+
+def header_values(path):
+    with open(path) as f:
+        text = f.read()
+
+    values = {}
+    for name, value in re.findall(r'#define\s+(MEM_\w+)\s+(0x[0-9a-fA-F]+|\d+)', text):
+        values[name] = int(value, 0)
+
+    enum = re.search(r'enum AMD_CHIPS\s*{(.*?)}', text, re.S)
+    if enum is None:
+        sys.exit('%s: enum AMD_CHIPS not found' % path)
+    n = 0
+    for item in re.sub(r'//.*|/\*.*?\*/', '', enum.group(1), flags=re.S).split(','):
+        item = item.strip()
+        if not item:
+            continue
+        if '=' in item:
+            item, value = (s.strip() for s in item.split('=', 1))
+            n = int(value, 0)
+        values[item] = n
+        n += 1
+
+    return values
+
+
+class Strings:
+    def __init__(self):
+        self.data = bytearray()
+        self.offsets = {}
+
+    def add(self, s):
+        if s not in self.offsets:
+            self.offsets[s] = len(self.data)
+            self.data += s.encode() + b'\0'
+        return self.offsets[s]
+
+
+def main():
+    if len(sys.argv) != 5:
+        sys.exit('usage: %s gpudb.h gputypes.txt memtypes.txt output.bin' % sys.argv[0])
+
+    values = header_values(sys.argv[1])
+    strings = Strings()
+
+    # first entry for a key wins, like the built-in index
+    gpus = {}
+    for lineno, (dev, sub, rev, asic, name) in gen_gpudb.parse(sys.argv[2], 5):
+        if asic not in values:
+            sys.exit('%s:%d: unknown ASIC %s' % (sys.argv[2], lineno, asic))
+        key = (int(sub, 0), int(rev, 0), int(dev, 0))
+        gpus.setdefault(key, (values[asic], name))
+
+    mems = {}
+    for lineno, (mtype, mfr, model, name) in gen_gpudb.parse(sys.argv[3], 4):
+        if mtype not in values:
+            sys.exit('%s:%d: unknown memory type %s' % (sys.argv[3], lineno, mtype))
+        if mtype == 'MEM_UNKNOWN':
+            break  # the built-in lookup never gets past it either
+        mfr, model = int(mfr, 0), int(model, 0)
+        if not -1 <= mfr <= 15 or not -1 <= model <= 15:
+            continue
+        mems.setdefault((values[mtype], mfr + 1, model + 1), name)
+
+    gpu_data = b''.join(GPU.pack(sub, dev, rev, asic, strings.add(name), 0)
+                        for (sub, rev, dev), (asic, name) in sorted(gpus.items()))
+    mem_data = b''.join(MEM.pack(t, mfr, model, 0, strings.add(name))
+                        for (t, mfr, model), name in sorted(mems.items()))
+
+    gpu_offset = HEADER.size
+    mem_offset = gpu_offset + len(gpu_data)
+    str_offset = mem_offset + len(mem_data)
+
+    with open(sys.argv[4], 'wb') as f:
+        f.write(HEADER.pack(MAGIC, VERSION, len(gpus), gpu_offset, len(mems), mem_offset,
+                            str_offset, len(strings.data), 0))
+        f.write(gpu_data)
+        f.write(mem_data)
+        f.write(strings.data)
+
+
+if __name__ == '__main__':
+    main()